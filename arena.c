@@ -0,0 +1,80 @@
+#include <stdbool.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "macro.h"
+#include "arena.h"
+
+
+static struct ArenaChunk *Arena_map (size_t size, bool huge) {
+  const size_t page =
+    huge ? ARENA_HUGE_PAGE_SIZE : (size_t) sysconf(_SC_PAGESIZE);
+  const size_t len =
+    (sizeof(struct ArenaChunk) + size + page - 1) & ~(page - 1);
+  void *p = MAP_FAILED;
+  if (huge) {
+    // only there if reserved by the administrator
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return_if_fail (p != MAP_FAILED) NULL;
+    if (huge) {
+      madvise(p, len, MADV_HUGEPAGE);
+    }
+  }
+  struct ArenaChunk *chunk = p;
+  chunk->size = len - sizeof(struct ArenaChunk);
+  return chunk;
+}
+
+
+void *Arena_reserve (struct Arena *self, size_t size) {
+  struct ArenaChunk *chunk = self->head;
+  return_if (chunk != NULL && chunk->size - chunk->used >= size)
+    chunk->data + chunk->used;
+
+  // the rest of the current chunk is wasted, at most one reservation
+  chunk = Arena_map(max(self->chunk_size, size), self->huge);
+  return_if_fail (chunk != NULL) NULL;
+  chunk->next = self->head;
+  chunk->used = 0;
+  self->head = chunk;
+  return chunk->data;
+}
+
+
+void Arena_commit (struct Arena *self, size_t size) {
+  struct ArenaChunk *chunk = self->head;
+  size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+  chunk->used = min(chunk->used + size, chunk->size);
+}
+
+
+void *Arena_alloc (struct Arena *self, size_t size) {
+  void *ret = Arena_reserve(self, size);
+  if (ret != NULL) {
+    Arena_commit(self, size);
+  }
+  return ret;
+}
+
+
+void Arena_destroy (struct Arena *self) {
+  for (struct ArenaChunk *chunk = self->head, *next; chunk != NULL;
+       chunk = next) {
+    next = chunk->next;
+    munmap(chunk, sizeof(struct ArenaChunk) + chunk->size);
+  }
+  self->head = NULL;
+}
+
+
+void Arena_init (struct Arena *self, size_t chunk_size, bool huge) {
+  self->head = NULL;
+  self->chunk_size = chunk_size;
+  self->huge = huge;
+}
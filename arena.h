@@ -0,0 +1,44 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+
+#define ARENA_ALIGN 16
+#define ARENA_CHUNK_SIZE (1 << 20)
+#define ARENA_HUGE_PAGE_SIZE (1 << 21)
+
+
+// a mapping of its own, size covers the rest of it
+struct ArenaChunk {
+  struct ArenaChunk *next;
+  size_t size;
+  size_t used;
+  _Alignas(ARENA_ALIGN) char data[];
+};
+
+// bump allocator, everything is freed at once
+struct Arena {
+  struct ArenaChunk *head;
+  size_t chunk_size;
+  // back chunks with huge pages if possible
+  bool huge;
+};
+
+
+// at least size bytes at the top, not allocated until Arena_commit()
+__attribute__((nonnull, warn_unused_result, alloc_size(2)))
+void *Arena_reserve (struct Arena *self, size_t size);
+// allocate size bytes of the last reservation
+__attribute__((nonnull))
+void Arena_commit (struct Arena *self, size_t size);
+__attribute__((nonnull, malloc, warn_unused_result, alloc_size(2)))
+void *Arena_alloc (struct Arena *self, size_t size);
+__attribute__((nonnull))
+void Arena_destroy (struct Arena *self);
+__attribute__((nonnull))
+void Arena_init (struct Arena *self, size_t chunk_size, bool huge);
+
+
+#endif /* ARENA_H */
@@ -0,0 +1,68 @@
+#include <stdbool.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "macro.h"
+#include "hash.h"
+#include "table.h"
+#include "cache.h"
+
+
+static inline __attribute__((always_inline)) void *BaseHostChainCache_find (
+    struct HostChainCache * restrict self,
+    const struct HostChainTable * restrict table, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch,
+    bool v6) {
+  const size_t addr_size =
+    v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+  struct HostChainCacheSlot *slot = self->slots +
+    HostHash_hash(addr, v6) % HOSTCHAINCACHE_SIZE;
+
+  // tables are never modified, a stale slot carries an old generation
+  if likely (slot->generation == table->generation &&
+             memcmp(&slot->addr, addr, addr_size) == 0) {
+    self->hit++;
+  } else {
+    self->miss++;
+    memcpy(&slot->addr, addr, addr_size);
+    slot->generation = table->generation;
+    slot->ambiguous = (v6 ?
+      HostChainTable6_resolve(table, addr, &slot->route) :
+      HostChainTable4_resolve(table, addr, &slot->route)) != 0;
+  }
+
+  if (slot->ambiguous) {
+    return v6 ?
+      HostChainTable6_find(table, addr, ttl, index, scratch) :
+      HostChainTable4_find(table, addr, ttl, index, scratch);
+  }
+  return v6 ?
+    HostChainTable6_route(&slot->route, ttl, index, scratch) :
+    HostChainTable4_route(&slot->route, ttl, index, scratch);
+}
+
+
+void *HostChainCache4_find (
+    struct HostChainCache * restrict self,
+    const struct HostChainTable * restrict table, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch) {
+  return BaseHostChainCache_find(
+    self, table, addr, ttl, index, scratch, false);
+}
+
+
+void *HostChainCache6_find (
+    struct HostChainCache * restrict self,
+    const struct HostChainTable * restrict table, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch) {
+  return BaseHostChainCache_find(self, table, addr, ttl, index, scratch, true);
+}
+
+
+void HostChainCache_init (struct HostChainCache *self) {
+  for (unsigned int i = 0; i < HOSTCHAINCACHE_SIZE; i++) {
+    self->slots[i].generation = 0;
+  }
+  self->hit = 0;
+  self->miss = 0;
+}
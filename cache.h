@@ -0,0 +1,48 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+#include "table.h"
+
+
+#define HOSTCHAINCACHE_SIZE 256
+
+
+struct HostChainCacheSlot {
+  struct in6_addr addr;
+  // generation of the table the route belongs to, 0 if empty
+  unsigned int generation;
+  // the route depends on TTL, do a full lookup
+  bool ambiguous;
+  struct HostChainRoute route;
+};
+
+// direct-mapped, per thread; shared by both address families
+struct HostChainCache {
+  struct HostChainCacheSlot slots[HOSTCHAINCACHE_SIZE];
+  unsigned long hit;
+  unsigned long miss;
+};
+
+
+__attribute__((nonnull, warn_unused_result, access(read_only, 2),
+               access(read_only, 3), access(write_only, 5),
+               access(write_only, 6)))
+void *HostChainCache4_find (
+  struct HostChainCache * restrict self,
+  const struct HostChainTable * restrict table, const void * restrict addr,
+  unsigned char ttl, unsigned char *index, void * restrict scratch);
+__attribute__((nonnull, warn_unused_result, access(read_only, 2),
+               access(read_only, 3), access(write_only, 5),
+               access(write_only, 6)))
+void *HostChainCache6_find (
+  struct HostChainCache * restrict self,
+  const struct HostChainTable * restrict table, const void * restrict addr,
+  unsigned char ttl, unsigned char *index, void * restrict scratch);
+__attribute__((nonnull))
+void HostChainCache_init (struct HostChainCache *self);
+
+
+#endif /* CACHE_H */
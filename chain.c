@@ -1,4 +1,5 @@
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -15,16 +16,77 @@
 #include "chain.h"
 
 
-#define HostChain_AT(self, i) \
-  ((struct FakeHost *) ((self)->_buf + struct_size * (i)))
+static inline size_t HostChain_addr_size (bool v6) {
+  return v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+}
+
+
+// offset of the first struct FakeHostInfo
+static inline size_t HostChain_info_offset (unsigned int len, bool v6) {
+  return (HostChain_addr_size(v6) * len + HOSTCHAIN_ALIGN - 1) &
+         ~(size_t) (HOSTCHAIN_ALIGN - 1);
+}
 
 
 size_t HostChain_nitem (const struct HostChain *self) {
-  const unsigned int struct_size =
-    self->v6 ? sizeof(struct FakeHost6) : sizeof(struct FakeHost);
-  unsigned int i;
-  for (i = 0; !BaseFakeHost_isnull(HostChain_AT(self, i), self->v6); i++) { }
-  return i;
+  return self->len;
+}
+
+
+size_t HostChain_size (unsigned int len, bool v6) {
+  return (HostChain_info_offset(len, v6) + sizeof(struct FakeHostInfo) * len +
+          HOSTCHAIN_ALIGN - 1) & ~(size_t) (HOSTCHAIN_ALIGN - 1);
+}
+
+
+const void *HostChain_addr (const struct HostChain *self, unsigned int i) {
+  return self->_buf + HostChain_addr_size(self->v6) * i;
+}
+
+
+static inline const struct FakeHostInfo *BaseHostChain_info (
+    const struct HostChain *self, unsigned int i, bool v6) {
+  return (const struct FakeHostInfo *) (
+    self->_buf + HostChain_info_offset(self->len, v6)) + i;
+}
+
+
+const struct FakeHostInfo *HostChain_info (
+    const struct HostChain *self, unsigned int i) {
+  return BaseHostChain_info(self, i, self->v6);
+}
+
+
+struct FakeHost *HostChain4_get (
+    const struct HostChain * restrict self, unsigned int i,
+    struct FakeHost * restrict host) {
+  const struct FakeHostInfo *info = BaseHostChain_info(self, i, false);
+  host->ttl = info->ttl;
+  host->mtu = info->mtu;
+  host->reply_sum = info->reply_sum;
+  host->addr = self->v4_addrs[i];
+  return host;
+}
+
+
+struct FakeHost6 *HostChain6_get (
+    const struct HostChain * restrict self, unsigned int i,
+    struct FakeHost6 * restrict host) {
+  const struct FakeHostInfo *info = BaseHostChain_info(self, i, true);
+  host->ttl = info->ttl;
+  host->mtu = info->mtu;
+  host->reply_sum = info->reply_sum;
+  host->addr = self->v6_addrs[i];
+  return host;
+}
+
+
+void *HostChain_get (
+    const struct HostChain * restrict self, unsigned int i,
+    void * restrict host) {
+  return self->v6 ?
+    (void *) HostChain6_get(self, i, host) :
+    (void *) HostChain4_get(self, i, host);
 }
 
 
@@ -32,7 +94,9 @@ int HostChain_compare (
     const struct HostChain * restrict self,
     const struct HostChain * restrict other) {
   return_nonzero (cmp(other->prefix, self->prefix));
-  return memcmp(self->network, other->network, (self->v6 ? 128 : 32) / 4);
+  return memcmp(
+    self->network, other->network,
+    self->v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
 }
 
 
@@ -42,39 +106,231 @@ bool HostChain_in (
 }
 
 
-void *HostChain_find (
-    const struct HostChain * restrict self, const void * restrict addr,
-    unsigned char ttl, bool *found, unsigned char *index) {
-  const unsigned int struct_size =
-    self->v6 ? sizeof(struct FakeHost6) : sizeof(struct FakeHost);
-  unsigned int i;
-  for (i = 0; ttl > 0 && !BaseFakeHost_isnull(HostChain_AT(self, i), self->v6);
-       i++, ttl--) {
-    if (self->v6 ?
-          IN6_ARE_ADDR_EQUAL(&self->v6_hosts[i].addr, addr) :
-          self->v4_hosts[i].addr.s_addr == ((struct in_addr *) addr)->s_addr) {
-      *found = true;
-      goto end;
+// all engines return the first match among the first n addresses, or -1
+
+static int HostChain_find4_generic (
+    const struct in_addr *addrs, unsigned int n, in_addr_t a) {
+  for (unsigned int i = 0; i < n; i++) {
+    return_if (addrs[i].s_addr == a) i;
+  }
+  return -1;
+}
+
+
+static int HostChain_find6_generic (
+    const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a) {
+  for (unsigned int i = 0; i < n; i++) {
+    return_if (IN6_ARE_ADDR_EQUAL(addrs + i, a)) i;
+  }
+  return -1;
+}
+
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static int HostChain_find4_sse2 (
+    const struct in_addr *addrs, unsigned int n, in_addr_t a) {
+  return_if (n < 4) HostChain_find4_generic(addrs, n, a);
+  const __m128i key = _mm_set1_epi32(a);
+  for (unsigned int i = 0;; i += 4) {
+    // the last step overlaps the previous one instead of reading past n
+    if (i + 4 > n) {
+      i = n - 4;
     }
+    __m128i x = _mm_loadu_si128((const __m128i *) (addrs + i));
+    int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(x, key)));
+    return_if (mask != 0) i + __builtin_ctz(mask);
+    return_if (i + 4 >= n) -1;
+  }
+}
+
+
+__attribute__((target("sse2")))
+static int HostChain_find6_sse2 (
+    const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a) {
+  const __m128i key = _mm_loadu_si128((const __m128i *) a);
+  unsigned int i = 0;
+  for (; i + 2 <= n; i += 2) {
+    __m128i x0 = _mm_loadu_si128((const __m128i *) (addrs + i));
+    __m128i x1 = _mm_loadu_si128((const __m128i *) (addrs + i + 1));
+    unsigned int mask0 = _mm_movemask_epi8(_mm_cmpeq_epi8(x0, key));
+    unsigned int mask1 = _mm_movemask_epi8(_mm_cmpeq_epi8(x1, key));
+    unsigned int mask = mask0 | mask1 << 16;
+    continue_if_not ((mask & 0xffff) == 0xffff || mask >> 16 == 0xffff);
+    return i + ((mask & 0xffff) != 0xffff);
+  }
+  if (i < n) {
+    __m128i x = _mm_loadu_si128((const __m128i *) (addrs + i));
+    return_if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, key)) == 0xffff) i;
   }
-  return_if (i == 0) NULL;
-  *found = false;
-  i--;
-end:
-  *index = i;
-  return HostChain_AT(self, i);
+  return -1;
+}
+
+
+__attribute__((target("avx2")))
+static int HostChain_find4_avx2 (
+    const struct in_addr *addrs, unsigned int n, in_addr_t a) {
+  return_if (n < 16) HostChain_find4_sse2(addrs, n, a);
+  const __m256i key = _mm256_set1_epi32(a);
+  int ret = -1;
+  for (unsigned int i = 0;; i += 16) {
+    if (i + 16 > n) {
+      i = n - 16;
+    }
+    __m256i x0 = _mm256_loadu_si256((const __m256i *) (addrs + i));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *) (addrs + i + 8));
+    unsigned int mask =
+      _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(x0, key))) |
+      _mm256_movemask_ps(
+        _mm256_castsi256_ps(_mm256_cmpeq_epi32(x1, key))) << 8;
+    if (mask != 0) {
+      ret = i + __builtin_ctz(mask);
+      break;
+    }
+    break_if (i + 16 >= n);
+  }
+  _mm256_zeroupper();
+  return ret;
+}
+
+
+__attribute__((target("avx2")))
+static int HostChain_find6_avx2 (
+    const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a) {
+  return_if (n < 4) HostChain_find6_sse2(addrs, n, a);
+  const __m256i key =
+    _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *) a));
+  int ret = -1;
+  for (unsigned int i = 0;; i += 4) {
+    if (i + 4 > n) {
+      i = n - 4;
+    }
+    __m256i x0 = _mm256_loadu_si256((const __m256i *) (addrs + i));
+    __m256i x1 = _mm256_loadu_si256((const __m256i *) (addrs + i + 2));
+    unsigned int mask =
+      _mm256_movemask_pd(_mm256_castsi256_pd(_mm256_cmpeq_epi64(x0, key))) |
+      _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpeq_epi64(x1, key))) << 4;
+    // an address matches if both of its 64-bit halves do
+    mask &= (mask >> 1) & 0x55;
+    if (mask != 0) {
+      ret = i + __builtin_ctz(mask) / 2;
+      break;
+    }
+    break_if (i + 4 >= n);
+  }
+  _mm256_zeroupper();
+  return ret;
+}
+
+#elif defined __ARM_NEON && defined USE_NEON
+#include <arm_neon.h>
+
+static int HostChain_find4_neon (
+    const struct in_addr *addrs, unsigned int n, in_addr_t a) {
+  return_if (n < 4) HostChain_find4_generic(addrs, n, a);
+  const uint32x4_t key = vdupq_n_u32(a);
+  for (unsigned int i = 0;; i += 4) {
+    if (i + 4 > n) {
+      i = n - 4;
+    }
+    uint32x4_t x = vld1q_u32((const uint32_t *) (addrs + i));
+    // narrow each lane to 16 bits, so that the mask fits in 64 bits
+    uint64_t mask = vget_lane_u64(
+      vreinterpret_u64_u16(vmovn_u32(vceqq_u32(x, key))), 0);
+    return_if (mask != 0) i + __builtin_ctzll(mask) / 16;
+    return_if (i + 4 >= n) -1;
+  }
+}
+
+
+static int HostChain_find6_neon (
+    const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a) {
+  const uint32x4_t key = vld1q_u32((const uint32_t *) a);
+  for (unsigned int i = 0; i < n; i++) {
+    uint32x4_t x = vld1q_u32((const uint32_t *) (addrs + i));
+    uint64_t mask = vget_lane_u64(
+      vreinterpret_u64_u16(vmovn_u32(vceqq_u32(x, key))), 0);
+    return_if (mask == UINT64_MAX) i;
+  }
+  return -1;
+}
+#endif
+
+
+static int (*HostChain_find4_engine) (
+  const struct in_addr *addrs, unsigned int n, in_addr_t a) =
+  HostChain_find4_generic;
+static int (*HostChain_find6_engine) (
+  const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a) =
+  HostChain_find6_generic;
+
+
+__attribute__((constructor))
+static void HostChain_find_select (void) {
+#if defined __x86_64__ || defined __i386__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    HostChain_find4_engine = HostChain_find4_avx2;
+    HostChain_find6_engine = HostChain_find6_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    HostChain_find4_engine = HostChain_find4_sse2;
+    HostChain_find6_engine = HostChain_find6_sse2;
+  }
+#elif defined __ARM_NEON && defined USE_NEON
+  HostChain_find4_engine = HostChain_find4_neon;
+  HostChain_find6_engine = HostChain_find6_neon;
+#endif
+}
+
+
+int HostChain4_find (
+    const struct HostChain * restrict self,
+    const struct in_addr * restrict addr, unsigned char ttl) {
+  return HostChain_find4_engine(
+    self->v4_addrs, min(ttl, self->len), addr->s_addr);
+}
+
+
+int HostChain6_find (
+    const struct HostChain * restrict self,
+    const struct in6_addr * restrict addr, unsigned char ttl) {
+  return HostChain_find6_engine(self->v6_addrs, min(ttl, self->len), addr);
+}
+
+
+int HostChain_find (
+    const struct HostChain * restrict self, const void * restrict addr,
+    unsigned char ttl) {
+  return self->v6 ?
+    HostChain6_find(self, addr, ttl) : HostChain4_find(self, addr, ttl);
+}
+
+
+int HostChain_dup_index (
+    const struct HostChain * restrict self, const void * restrict addr) {
+  unsigned long long block;
+  return_if_fail (inet_block(
+    self->v6 ? AF_INET6 : AF_INET, addr, self->network, self->dup_prefix,
+    self->prefix, &block) == 0) -1;
+  return_if_not (block % self->dup_step == 0) -1;
+  block /= self->dup_step;
+  return block < self->ndup ? (int) block : -1;
 }
 
 
 int HostChain_shift (
-    struct HostChain *self, int offset, unsigned short prefix) {
+    struct HostChain *self, long long offset, unsigned short prefix) {
   const int af = self->v6 ? AF_INET6 : AF_INET;
-  const unsigned int struct_size =
-    self->v6 ? sizeof(struct FakeHost6) : sizeof(struct FakeHost);
   return_if_fail (inet_shift(af, self->network, offset, prefix) == 0) 16;
-  for (unsigned int i = 0;
-       !BaseFakeHost_isnull(HostChain_AT(self, i), self->v6); i++) {
-    inet_shift(af, &HostChain_AT(self, i)->addr, offset, prefix);
+  struct FakeHostInfo *infos = (struct FakeHostInfo *) (
+    self->_buf + HostChain_info_offset(self->len, self->v6));
+  for (unsigned int i = 0; i < self->len; i++) {
+    void *addr = self->_buf + HostChain_addr_size(self->v6) * i;
+    inet_shift(af, addr, offset, prefix);
+    infos[i].reply_sum = BaseFakeHost_sum(addr, self->v6);
   }
   return 0;
 }
@@ -102,6 +358,8 @@ const char *HostChain_strerror (int errnum) {
       return "route can only be specified once";
     case 10:
       return "route not in presentation format";
+    case 11:
+      return "unspecified address cannot be a host";
     case 16:
       return "'prefix' must be less or equal than the network prefix";
     case 17:
@@ -116,42 +374,74 @@ const char *HostChain_strerror (int errnum) {
 }
 
 
+int HostChain_duplicate (
+    struct HostChain * restrict self, const struct HostChain * restrict other,
+    unsigned short step, unsigned char prefix, unsigned int n) {
+  return_nonzero (HostChain_copy(self, other));
+  // start from the last copy of other
+  if (other->ndup > 1) {
+    HostChain_shift(
+      self, (long long) other->dup_step * (other->ndup - 1),
+      other->dup_prefix);
+  }
+  HostChain_shift(self, step, prefix);
+  self->dup_prefix = prefix;
+  self->dup_step = step;
+  self->ndup = n;
+  return 0;
+}
+
+
 void HostChain_destroy (struct HostChain *self) {
-  free(self->_buf);
+  if (!self->in_arena) {
+    free(self->_buf);
+  }
 }
 
 
 int HostChain_copy (
     struct HostChain * restrict self, const struct HostChain * restrict other) {
-  const unsigned int struct_size =
-    other->v6 ? sizeof(struct FakeHost6) : sizeof(struct FakeHost);
+  const size_t size = HostChain_size(other->len, other->v6);
   *self = *other;
-  unsigned int len = HostChain_nitem(other) + 1;
-  self->_buf = malloc(struct_size * len);
+  self->in_arena = false;
+  self->_buf = malloc(size);
   return_if_fail (self->_buf != NULL) -1;
-  memcpy(self->_buf, other->_buf, struct_size * len);
+  memcpy(self->_buf, other->_buf, size);
   return 0;
 }
 
 
-int HostChain_init (
-    struct HostChain * restrict self, const char * restrict s, bool v6) {
-  const unsigned int struct_size =
-    v6 ? sizeof(struct FakeHost6) : sizeof(struct FakeHost);
+static void HostChain_set (
+    struct FakeHostInfo * restrict info, const void * restrict addr,
+    unsigned char ttl, unsigned short mtu, bool v6) {
+  info->reply_sum = BaseFakeHost_sum(addr, v6);
+  info->mtu = mtu;
+  info->ttl = ttl;
+}
+
+
+// parse s in place into self->_buf, which has HostChain_size(MAXTTL) bytes
+static int HostChain_parse (
+    struct HostChain * restrict self, char * restrict s, bool v6) {
+  const size_t addr_size = HostChain_addr_size(v6);
   const int af = v6 ? AF_INET6 : AF_INET;
+  // until the length is known, infos follow room for MAXTTL addresses
+  struct FakeHostInfo *infos = (struct FakeHostInfo *) (
+    self->_buf + HostChain_info_offset(MAXTTL, v6));
 
   int ret;
-  self->_buf = malloc(struct_size * MAXTTL);
-  char *s_ = strdup(s);
-  test_goto (self->_buf != NULL && s_ != NULL, -1) fail;
   self->prefix = 0;
+  memset(self->network, 0, sizeof(struct in6_addr));
   self->v6 = v6;
+  self->dup_prefix = 0;
+  self->dup_step = 0;
+  self->ndup = 1;
 
   bool route_set = false;
   unsigned int ttl = 0;
   unsigned int mtu = 0;
   unsigned int i = 0;
-  for (char *saved_comma, *token = strtok_r(s_, ",", &saved_comma);
+  for (char *saved_comma, *token = strtok_r(s, ",", &saved_comma);
        token != NULL;
        token = strtok_r(NULL, ",", &saved_comma)) {
     char *value = strchr(token, '=');
@@ -217,19 +507,24 @@ int HostChain_init (
       }
 
       // parse first component
-      struct FakeHost *host = HostChain_AT(self, i);
-      test_goto (inet_pton(af, token, &host->addr) == 1, 2) fail;
-      host->ttl = ttl;
-      host->mtu = mtu;
+      void *addr = self->_buf + addr_size * i;
+      test_goto (inet_pton(af, token, addr) == 1, 2) fail;
+      test_goto (v6 ?
+        !IN6_IS_ADDR_UNSPECIFIED((struct in6_addr *) addr) :
+        ((struct in_addr *) addr)->s_addr != INADDR_ANY, 11) fail;
+      HostChain_set(infos + i, addr, ttl, mtu, v6);
       i++;
 
       // parse second component
       if (next_dash != NULL) {
         unsigned char addr_end[sizeof(struct in6_addr)];
         test_goto (inet_pton(af, next_dash + 1, addr_end) == 1, 2) fail;
+        test_goto (v6 ?
+          !IN6_IS_ADDR_UNSPECIFIED((struct in6_addr *) addr_end) :
+          ((struct in_addr *) addr_end)->s_addr != INADDR_ANY, 11) fail;
 
         if likely (memcmp(
-            &host->addr, addr_end,
+            addr, addr_end,
             v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr)) != 0) {
           register const int prefix_len =
             sizeof(struct in6_addr) - sizeof(struct in_addr);
@@ -240,17 +535,17 @@ int HostChain_init (
             // compare the leading 96 (128-32) bits
             // if mismatched, the range must be too large (>= 256)
             test_goto (memcmp(
-              ((struct FakeHost6 *) host)->addr.s6_addr,
+              ((struct in6_addr *) addr)->s6_addr,
               ((struct in6_addr *) addr_end)->s6_addr,
               prefix_len) == 0, 3) fail;
             memcpy(prefix, ((struct in6_addr *) addr_end)->s6_addr,
                    sizeof(prefix));
             start = ntohl(*((in_addr_t *) (
-              ((struct FakeHost6 *) host)->addr.s6_addr + prefix_len)));
+              ((struct in6_addr *) addr)->s6_addr + prefix_len)));
             stop = ntohl(*((in_addr_t *) (
               ((struct in6_addr *) addr_end)->s6_addr + prefix_len)));
           } else {
-            start = ntohl(host->addr.s_addr);
+            start = ntohl(((struct in_addr *) addr)->s_addr);
             stop = ntohl(((struct in_addr *) addr_end)->s_addr);
           }
           // assert(start != stop)
@@ -259,18 +554,17 @@ int HostChain_init (
           unsigned int n_addr = (stop - start) * step + 1;
           test_goto (i + n_addr < MAXTTL, 3) fail;
           for (unsigned int j = 1; j < n_addr; j++) {
-            struct FakeHost *host_j = HostChain_AT(self, i + j);
+            void *addr_j = self->_buf + addr_size * (i + j);
             if (v6) {
-              memcpy(((struct FakeHost6 *) host_j)->addr.s6_addr, prefix,
+              memcpy(((struct in6_addr *) addr_j)->s6_addr, prefix,
                      sizeof(prefix));
               *((in_addr_t *) (
-                  ((struct FakeHost6 *) host_j)->addr.s6_addr + prefix_len)) =
+                  ((struct in6_addr *) addr_j)->s6_addr + prefix_len)) =
                 htonl(start + j * step);
             } else {
-              host_j->addr.s_addr = htonl(start + j * step);
+              ((struct in_addr *) addr_j)->s_addr = htonl(start + j * step);
             }
-            host_j->ttl = ttl;
-            host_j->mtu = mtu;
+            HostChain_set(infos + i + j, addr_j, ttl, mtu, v6);
           }
           i += n_addr;
         }
@@ -283,7 +577,7 @@ int HostChain_init (
         LOGEVENT_LOG("Parsed address '%s': ", token);
         for (unsigned int j = old_i; j < i; j++) {
           char s_addr[INET6_ADDRSTRLEN];
-          inet_ntop( af, &HostChain_AT(self, j)->addr, s_addr, sizeof(s_addr));
+          inet_ntop(af, self->_buf + addr_size * j, s_addr, sizeof(s_addr));
           if (j != old_i) {
             LOGEVENT_PUTS(", ");
           }
@@ -294,65 +588,44 @@ int HostChain_init (
   }
   test_goto (i != 0, 1) fail;
 
-  free(s_);
-  // resize buf and finish with 0
-  self->_buf = realloc(self->_buf, struct_size * (i + 1));
-  memset(self->_buf + struct_size * i, 0, struct_size);
+  self->len = i;
+  memmove(self->_buf + HostChain_info_offset(i, v6), infos,
+          sizeof(struct FakeHostInfo) * i);
   return 0;
 
 fail:
-  free(self->_buf);
-  free(s_);
   return ret;
 }
 
 
-void *HostChainArray_find (
-    const struct HostChain * restrict self, const void * restrict addr,
-    unsigned char ttl, unsigned char *index) {
-  void *ret = NULL;
-  for (unsigned int i = 0; self[i]._buf != NULL; i++) {
-    continue_if_not (HostChain_in(self + i, addr));
-    bool found;
-    void *host = HostChain_find(self + i, addr, ttl, &found, index);
-    break_if_not (host != NULL);
-    ret = host;
-    break_if (found);
-  }
-  return ret;
+int HostChain_init_arena (
+    struct HostChain * restrict self, char * restrict s, bool v6,
+    struct Arena * restrict arena) {
+  self->_buf = Arena_reserve(arena, HostChain_size(MAXTTL, v6));
+  return_if_fail (self->_buf != NULL) -1;
+  return_nonzero (HostChain_parse(self, s, v6));
+  Arena_commit(arena, HostChain_size(self->len, v6));
+  self->in_arena = true;
+  return 0;
 }
 
 
-int HostChain4Array_reply (
-    const struct HostChain * restrict self,
-    void *packet, unsigned short *len) {
-  const struct ip *receive = packet;
-  return_if_fail (receive->ip_ttl > 0) 18;
-  unsigned char index;
-  const struct FakeHost *host = HostChainArray_find(
-    self, &receive->ip_dst, receive->ip_ttl, &index);
-  return_if_fail (host != NULL) 17;
-  int ret = FakeHost_reply(host, index, packet, len);
-  if (ret > 0) {
-    ret += 18;
-  }
-  return ret;
-}
-
+int HostChain_init (
+    struct HostChain * restrict self, const char * restrict s, bool v6) {
+  int ret;
+  self->_buf = malloc(HostChain_size(MAXTTL, v6));
+  char *s_ = strdup(s);
+  test_goto (self->_buf != NULL && s_ != NULL, -1) fail;
+  goto_nonzero (HostChain_parse(self, s_, v6)) fail;
+  free(s_);
+  // resize buf
+  self->_buf = realloc(self->_buf, HostChain_size(self->len, v6));
+  self->in_arena = false;
+  return 0;
 
-int HostChain6Array_reply (
-    const struct HostChain * restrict self,
-    void *packet, unsigned short *len) {
-  const struct ip6_hdr *receive = packet;
-  return_if_fail (receive->ip6_hlim > 0) 18;
-  unsigned char index;
-  const struct FakeHost6 *host = HostChainArray_find(
-    self, &receive->ip6_dst, receive->ip6_hlim, &index);
-  return_if_fail (host != NULL) 17;
-  int ret = FakeHost6_reply(host, index, packet, len);
-  if (ret > 0) {
-    ret += 18;
-  }
+fail:
+  free(self->_buf);
+  free(s_);
   return ret;
 }
 
@@ -371,6 +644,31 @@ void HostChainArray_sort (struct HostChain *self) {
 }
 
 
+size_t HostChainArray_packed_size (const struct HostChain *self, size_t n) {
+  size_t size = 0;
+  for (size_t i = 0; i < n; i++) {
+    size += (HostChain_size(self[i].len, self[i].v6) + ARENA_ALIGN - 1) &
+            ~(size_t) (ARENA_ALIGN - 1);
+  }
+  return size;
+}
+
+
+int HostChainArray_pack (
+    struct HostChain * restrict self, size_t n, struct Arena * restrict arena) {
+  for (size_t i = 0; i < n; i++) {
+    const size_t size = HostChain_size(self[i].len, self[i].v6);
+    char *buf = Arena_alloc(arena, size);
+    return_if_fail (buf != NULL) -1;
+    memcpy(buf, self[i]._buf, size);
+    HostChain_destroy(self + i);
+    self[i]._buf = buf;
+    self[i].in_arena = true;
+  }
+  return 0;
+}
+
+
 void HostChainArray_destroy_size (struct HostChain *self, size_t n) {
   for (unsigned int i = 0; i < n; i++) {
     promise (self[i]._buf != self[i + 1]._buf);
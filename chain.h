@@ -5,15 +5,23 @@
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 
+#include "arena.h"
 // #include "host.h"
+struct FakeHostInfo;
 struct FakeHost;
 struct FakeHost6;
 
 
+// hosts storage of every chain is aligned to this
+#define HOSTCHAIN_ALIGN 16
+
+
 struct HostChain {
+  // addresses of all hosts, then their struct FakeHostInfo starting at the
+  // next HOSTCHAIN_ALIGN boundary, so that lookups touch only addresses
   union {
-    struct FakeHost *v4_hosts;
-    struct FakeHost6 *v6_hosts;
+    struct in_addr *v4_addrs;
+    struct in6_addr *v6_addrs;
     char *_buf;
   };
   union {
@@ -23,11 +31,41 @@ struct HostChain {
   };
   unsigned char prefix;
   bool v6;
+  // number of hosts
+  unsigned char len;
+  // the chain stands for ndup copies, the n-th copy is shifted by
+  // n * dup_step * 2^(width - dup_prefix)
+  unsigned char dup_prefix;
+  // hosts belong to an arena, and are not freed with the chain
+  bool in_arena;
+  unsigned short dup_step;
+  unsigned int ndup;
 };
 
 
 __attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
 size_t HostChain_nitem (const struct HostChain *self);
+// bytes of hosts storage for len hosts
+__attribute__((const, warn_unused_result))
+size_t HostChain_size (unsigned int len, bool v6);
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+const void *HostChain_addr (const struct HostChain *self, unsigned int i);
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+const struct FakeHostInfo *HostChain_info (
+  const struct HostChain *self, unsigned int i);
+// fill host, a struct FakeHost or FakeHost6, with the i-th host
+__attribute__((nonnull, access(read_only, 1), access(write_only, 3)))
+struct FakeHost *HostChain4_get (
+  const struct HostChain * restrict self, unsigned int i,
+  struct FakeHost * restrict host);
+__attribute__((nonnull, access(read_only, 1), access(write_only, 3)))
+struct FakeHost6 *HostChain6_get (
+  const struct HostChain * restrict self, unsigned int i,
+  struct FakeHost6 * restrict host);
+__attribute__((nonnull, access(read_only, 1), access(write_only, 3)))
+void *HostChain_get (
+  const struct HostChain * restrict self, unsigned int i,
+  void * restrict host);
 __attribute__((nonnull, pure, warn_unused_result,
                access(read_only, 1), access(read_only, 2)))
 int HostChain_compare (
@@ -37,15 +75,33 @@ __attribute__((nonnull, pure, warn_unused_result,
                access(read_only, 1), access(read_only, 2)))
 bool HostChain_in (
   const struct HostChain * restrict self, const void * restrict addr);
-__attribute__((
-  nonnull, warn_unused_result, access(read_only, 1), access(read_only, 2),
-  access(write_only, 4), access(write_only, 5)))
-void *HostChain_find (
+// index of addr among the first ttl hosts, or -1
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+int HostChain4_find (
+  const struct HostChain * restrict self, const struct in_addr * restrict addr,
+  unsigned char ttl);
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+int HostChain6_find (
+  const struct HostChain * restrict self,
+  const struct in6_addr * restrict addr, unsigned char ttl);
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+int HostChain_find (
   const struct HostChain * restrict self, const void * restrict addr,
-  unsigned char ttl, bool *found, unsigned char *index);
+  unsigned char ttl);
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+int HostChain_dup_index (
+  const struct HostChain * restrict self, const void * restrict addr);
 __attribute__((nonnull))
 int HostChain_shift (
-  struct HostChain *self, int offset, unsigned short prefix);
+  struct HostChain *self, long long offset, unsigned short prefix);
+__attribute__((nonnull, warn_unused_result, access(read_only, 2)))
+int HostChain_duplicate (
+  struct HostChain * restrict self, const struct HostChain * restrict other,
+  unsigned short step, unsigned char prefix, unsigned int n);
 __attribute__((const, warn_unused_result))
 const char *HostChain_strerror (int errnum);
 __attribute__((nonnull))
@@ -53,6 +109,10 @@ void HostChain_destroy (struct HostChain *self);
 __attribute__((nonnull, warn_unused_result, access(read_only, 2)))
 int HostChain_copy (
   struct HostChain * restrict self, const struct HostChain * restrict other);
+__attribute__((nonnull, warn_unused_result))
+int HostChain_init_arena (
+  struct HostChain * restrict self, char * restrict s, bool v6,
+  struct Arena * restrict arena);
 __attribute__((nonnull, warn_unused_result, access(read_only, 2)))
 int HostChain_init (
   struct HostChain * restrict self, const char * restrict s, bool v6);
@@ -60,21 +120,17 @@ int HostChain_init (
 
 /***/
 
-__attribute__((nonnull, warn_unused_result, access(read_only, 1),
-               access(read_only, 2), access(write_only, 4)))
-void *HostChainArray_find (
-  const struct HostChain * restrict self, const void * restrict addr,
-  unsigned char ttl, unsigned char *index);
-__attribute__((nonnull, access(read_only, 1)))
-int HostChain4Array_reply (
-  const struct HostChain * restrict self, void *packet, unsigned short *len);
-__attribute__((nonnull, access(read_only, 1)))
-int HostChain6Array_reply (
-  const struct HostChain * restrict self, void *packet, unsigned short *len);
 __attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
 size_t HostChainArray_nitem (const struct HostChain *self);
 __attribute__((nonnull))
 void HostChainArray_sort (struct HostChain *self);
+// room taken by the hosts of n chains in an arena
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+size_t HostChainArray_packed_size (const struct HostChain *self, size_t n);
+// move the hosts of n chains into arena, one after another
+__attribute__((nonnull, warn_unused_result))
+int HostChainArray_pack (
+  struct HostChain * restrict self, size_t n, struct Arena * restrict arena);
 __attribute__((nonnull))
 void HostChainArray_destroy_size (struct HostChain *self, size_t n);
 __attribute__((nonnull))
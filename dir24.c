@@ -0,0 +1,98 @@
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "macro.h"
+#include "dir24.h"
+
+
+// set the entries of [first, first + n) not set yet
+static void RouteDir24_fill (
+    uint32_t *entries, uint32_t first, uint32_t n, uint32_t entry) {
+  for (uint32_t i = first; i < first + n; i++) {
+    if (entries[i] == 0) {
+      entries[i] = entry;
+    }
+  }
+}
+
+
+// the block of an unset entry of tbl24 is created empty
+static uint32_t *RouteDir24_block (struct RouteDir24 *self, uint32_t i) {
+  uint32_t entry = self->tbl24[i];
+  if (!(entry & ROUTEDIR24_LONG)) {
+    if (self->ntbl8 >= self->cap) {
+      unsigned int cap = self->cap * 2;
+      return_if_fail (cap < ROUTEDIR24_LONG) NULL;
+      uint32_t *tbl8 = realloc(
+        self->tbl8, sizeof(uint32_t) * 256 * (size_t) cap);
+      return_if_fail (tbl8 != NULL) NULL;
+      self->tbl8 = tbl8;
+      self->cap = cap;
+    }
+    memset(self->tbl8 + ((size_t) self->ntbl8 << 8), 0,
+           sizeof(uint32_t) * 256);
+    entry = ROUTEDIR24_LONG | self->ntbl8;
+    self->tbl24[i] = entry;
+    self->ntbl8++;
+  }
+  return self->tbl8 + ((size_t) (entry & ~ROUTEDIR24_LONG) << 8);
+}
+
+
+int RouteDir24_insert (
+    struct RouteDir24 * restrict self, const void * restrict network,
+    unsigned char prefix, unsigned int value) {
+  should (prefix <= 32 && value < ROUTEDIR24_LONG - 1) otherwise {
+    errno = EINVAL;
+    return -1;
+  }
+  uint32_t a;
+  memcpy(&a, network, sizeof(a));
+  a = ntohl(a);
+  const uint32_t entry = value + 1;
+
+  if (prefix <= 24) {
+    const uint32_t n = UINT32_C(1) << (24 - prefix);
+    const uint32_t first = (a >> 8) & ~(n - 1);
+    for (uint32_t i = first; i < first + n; i++) {
+      if (self->tbl24[i] & ROUTEDIR24_LONG) {
+        RouteDir24_fill(RouteDir24_block(self, i), 0, 256, entry);
+      } else if (self->tbl24[i] == 0) {
+        self->tbl24[i] = entry;
+      }
+    }
+  } else {
+    const uint32_t i = a >> 8;
+    // already held by a shorter route
+    return_if (self->tbl24[i] != 0 && !(self->tbl24[i] & ROUTEDIR24_LONG)) 0;
+    uint32_t *block = RouteDir24_block(self, i);
+    return_if_fail (block != NULL) -1;
+    const uint32_t n = UINT32_C(1) << (32 - prefix);
+    RouteDir24_fill(block, a & 0xff & ~(n - 1), n, entry);
+  }
+  return 0;
+}
+
+
+void RouteDir24_destroy (struct RouteDir24 *self) {
+  free(self->tbl8);
+  free(self->tbl24);
+}
+
+
+int RouteDir24_init (struct RouteDir24 *self) {
+  // large enough to be mmap'd, so that only touched pages take memory
+  self->tbl24 = calloc(UINT32_C(1) << 24, sizeof(uint32_t));
+  return_if_fail (self->tbl24 != NULL) -1;
+  self->cap = 16;
+  self->ntbl8 = 0;
+  self->tbl8 = malloc(sizeof(uint32_t) * 256 * self->cap);
+  should (self->tbl8 != NULL) otherwise {
+    free(self->tbl24);
+    return -1;
+  }
+  return 0;
+}
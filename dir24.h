@@ -0,0 +1,49 @@
+#ifndef DIR24_H
+#define DIR24_H
+
+#include <stdint.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+
+#define ROUTEDIR24_NONE ((unsigned int) -1)
+// entry points to a block of 256 entries for the last 8 bits
+#define ROUTEDIR24_LONG (UINT32_C(1) << 31)
+
+
+// DIR-24-8 for IPv4 routes; entries hold value + 1, 0 if none
+struct RouteDir24 {
+  // indexed by the first 24 bits, mostly untouched pages
+  uint32_t *tbl24;
+  uint32_t *tbl8;
+  unsigned int ntbl8;
+  unsigned int cap;
+};
+
+
+// value of the first route inserted that holds addr, or ROUTEDIR24_NONE
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+static inline unsigned int RouteDir24_lookup (
+    const struct RouteDir24 * restrict self, const void * restrict addr) {
+  uint32_t a;
+  memcpy(&a, addr, sizeof(a));
+  a = ntohl(a);
+  uint32_t entry = self->tbl24[a >> 8];
+  if (entry & ROUTEDIR24_LONG) {
+    entry = self->tbl8[((entry & ~ROUTEDIR24_LONG) << 8) | (a & 0xff)];
+  }
+  return entry - 1;
+}
+// insert routes from the shortest, so that a shorter route wins
+__attribute__((nonnull, warn_unused_result, access(read_only, 2)))
+int RouteDir24_insert (
+  struct RouteDir24 * restrict self, const void * restrict network,
+  unsigned char prefix, unsigned int value);
+__attribute__((nonnull))
+void RouteDir24_destroy (struct RouteDir24 *self);
+__attribute__((nonnull, warn_unused_result))
+int RouteDir24_init (struct RouteDir24 *self);
+
+
+#endif /* DIR24_H */
@@ -0,0 +1,37 @@
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <threads.h>
+
+#include "macro.h"
+#include "epoch.h"
+
+
+void Epoch_synchronize (struct Epoch *self) {
+  // readers that entered before this see the old pointers at most
+  unsigned int epoch = atomic_fetch_add(&self->epoch, 1) + 1;
+  for (unsigned int i = 0; i < self->nreader; i++) {
+    while (1) {
+      unsigned int seen = atomic_load(&self->readers[i].epoch);
+      break_if (seen == EPOCH_IDLE || seen >= epoch);
+      thrd_sleep(&(struct timespec) {.tv_nsec = 1000000}, NULL);
+    }
+  }
+}
+
+
+void Epoch_destroy (struct Epoch *self) {
+  free(self->readers);
+}
+
+
+int Epoch_init (struct Epoch *self, unsigned int nreader) {
+  self->readers = aligned_alloc(
+    _Alignof(struct EpochReader), sizeof(struct EpochReader) * nreader);
+  return_if_fail (self->readers != NULL) -1;
+  for (unsigned int i = 0; i < nreader; i++) {
+    atomic_init(&self->readers[i].epoch, EPOCH_IDLE);
+  }
+  atomic_init(&self->epoch, EPOCH_IDLE + 1);
+  self->nreader = nreader;
+  return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdatomic.h>
+
+
+// reader is outside any critical section
+#define EPOCH_IDLE 0
+
+
+struct EpochReader {
+  // epoch seen on entering, or EPOCH_IDLE
+  atomic_uint epoch;
+} __attribute__((aligned(64)));
+
+// epoch-based reclamation, readers never block or take a lock
+struct Epoch {
+  atomic_uint epoch;
+  unsigned int nreader;
+  struct EpochReader *readers;
+};
+
+
+// also a quiescent point if already entered; load shared pointers afterwards
+__attribute__((nonnull))
+static inline void EpochReader_enter (
+    struct EpochReader * restrict self, struct Epoch * restrict epoch) {
+  // seq_cst, so the store is visible before any load that follows
+  atomic_store(&self->epoch, atomic_load_explicit(
+    &epoch->epoch, memory_order_acquire));
+}
+
+__attribute__((nonnull))
+static inline void EpochReader_leave (struct EpochReader *self) {
+  atomic_store_explicit(&self->epoch, EPOCH_IDLE, memory_order_release);
+}
+
+// wait until no reader may still see what was unpublished before the call
+__attribute__((nonnull))
+void Epoch_synchronize (struct Epoch *self);
+__attribute__((nonnull))
+void Epoch_destroy (struct Epoch *self);
+__attribute__((nonnull, warn_unused_result))
+int Epoch_init (struct Epoch *self, unsigned int nreader);
+
+
+#endif /* EPOCH_H */
@@ -0,0 +1,48 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "macro.h"
+#include "filter.h"
+
+
+void RouteFilter_insert (
+    struct RouteFilter * restrict self, const void * restrict network,
+    unsigned char prefix, bool v6) {
+  if (prefix == 0) {
+    self->all = true;
+    return;
+  }
+
+  unsigned int i;
+  for (i = 0; i < self->nlen && self->lens[i] != prefix; i++) { }
+  if (i == self->nlen) {
+    self->lens[self->nlen++] = prefix;
+  }
+
+  uint64_t hi;
+  uint64_t lo;
+  RouteFilter_key(network, &hi, &lo, v6);
+  uint64_t h = RouteFilter_hash(hi, lo, prefix, v6);
+  self->words[h & self->mask] |= RouteFilter_bits(h);
+}
+
+
+void RouteFilter_destroy (struct RouteFilter *self) {
+  free(self->words);
+}
+
+
+int RouteFilter_init (struct RouteFilter *self, size_t n) {
+  // 16 bits per route, about 1% false positives per distinct route length
+  size_t size = 1;
+  while (size < n / 4) {
+    size *= 2;
+  }
+  self->words = calloc(size, sizeof(uint64_t));
+  return_if_fail (self->words != NULL) -1;
+  self->mask = size - 1;
+  self->all = false;
+  self->nlen = 0;
+  return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <endian.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "macro.h"
+#include "hash.h"
+
+
+// blocked Bloom filter over route prefixes, one word per key; a miss proves
+// that no route holds the address
+struct RouteFilter {
+  uint64_t *words;
+  unsigned int mask;
+  // a route of length 0 holds everything
+  bool all;
+  // distinct lengths of the inserted routes
+  unsigned char nlen;
+  unsigned char lens[128];
+};
+
+
+// address as a 128-bit number, v4 in the upper half
+__attribute__((nonnull, access(read_only, 1), access(write_only, 2),
+               access(write_only, 3)))
+static inline void RouteFilter_key (
+    const void *addr, uint64_t *hi, uint64_t *lo, bool v6) {
+  if (v6) {
+    memcpy(hi, addr, sizeof(*hi));
+    memcpy(lo, (const char *) addr + sizeof(*hi), sizeof(*lo));
+    *hi = be64toh(*hi);
+    *lo = be64toh(*lo);
+  } else {
+    uint32_t a;
+    memcpy(&a, addr, sizeof(a));
+    *hi = (uint64_t) be32toh(a) << 32;
+    *lo = 0;
+  }
+}
+// word index in the low bits, three bit positions above them
+__attribute__((const, warn_unused_result))
+static inline uint64_t RouteFilter_hash (
+    uint64_t hi, uint64_t lo, unsigned char len, bool v6) {
+  hi &= len >= 64 ? UINT64_MAX : ~(UINT64_MAX >> len);
+  if (!v6) {
+    return HostHash_mix(hi ^ len);
+  }
+  lo &= len <= 64 ? 0 :
+        len >= 128 ? UINT64_MAX : ~(UINT64_MAX >> (len - 64));
+  return HostHash_mix(hi ^ HostHash_mix(lo ^ len));
+}
+__attribute__((const, warn_unused_result))
+static inline uint64_t RouteFilter_bits (uint64_t h) {
+  return (UINT64_C(1) << ((h >> 32) & 63)) |
+         (UINT64_C(1) << ((h >> 38) & 63)) |
+         (UINT64_C(1) << ((h >> 44) & 63));
+}
+// false if no inserted route holds addr
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+static inline bool RouteFilter_has (
+    const struct RouteFilter * restrict self, const void * restrict addr,
+    bool v6) {
+  return_if (self->all) true;
+  uint64_t hi;
+  uint64_t lo;
+  RouteFilter_key(addr, &hi, &lo, v6);
+  for (unsigned int i = 0; i < self->nlen; i++) {
+    uint64_t h = RouteFilter_hash(hi, lo, self->lens[i], v6);
+    uint64_t bits = RouteFilter_bits(h);
+    return_if ((self->words[h & self->mask] & bits) == bits) true;
+  }
+  return false;
+}
+__attribute__((nonnull, access(read_only, 2)))
+void RouteFilter_insert (
+  struct RouteFilter * restrict self, const void * restrict network,
+  unsigned char prefix, bool v6);
+__attribute__((nonnull))
+void RouteFilter_destroy (struct RouteFilter *self);
+// sized for n routes
+__attribute__((nonnull, warn_unused_result))
+int RouteFilter_init (struct RouteFilter *self, size_t n);
+
+
+#endif /* FILTER_H */
@@ -0,0 +1,42 @@
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "macro.h"
+#include "hash.h"
+
+
+void HostHash_insert (
+    struct HostHash * restrict self, const void * restrict addr,
+    unsigned int chain, unsigned char index) {
+  unsigned int i = HostHash_start(self, addr, self->v6);
+  while (self->slots[i].used) {
+    i = (i + 1) & self->mask;
+  }
+  struct HostHashSlot *slot = self->slots + i;
+  memcpy(&slot->addr, addr,
+         self->v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
+  slot->chain = chain;
+  slot->index = index;
+  slot->used = true;
+}
+
+
+void HostHash_destroy (struct HostHash *self) {
+  free(self->slots);
+}
+
+
+int HostHash_init (struct HostHash *self, size_t n, bool v6) {
+  // keep load factor under 1/2
+  size_t size = 16;
+  while (size < n * 2) {
+    size *= 2;
+  }
+  self->slots = calloc(size, sizeof(struct HostHashSlot));
+  return_if_fail (self->slots != NULL) -1;
+  self->mask = size - 1;
+  self->v6 = v6;
+  return 0;
+}
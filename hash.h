@@ -0,0 +1,85 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <netinet/in.h>
+
+
+struct HostHashSlot {
+  struct in6_addr addr;
+  unsigned int chain;
+  unsigned char index;
+  bool used;
+};
+
+// open addressing, linear probing; an address may occur more than once
+struct HostHash {
+  struct HostHashSlot *slots;
+  unsigned int mask;
+  bool v6;
+};
+
+
+__attribute__((const, warn_unused_result))
+static inline uint64_t HostHash_mix (uint64_t h) {
+  // MurmurHash3 finalizer, every input bit reaches every output bit
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccd;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53;
+  h ^= h >> 33;
+  return h;
+}
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+static inline uint32_t HostHash_hash (const void *addr, bool v6) {
+  uint64_t h;
+  if (v6) {
+    uint64_t hi;
+    uint64_t lo;
+    memcpy(&hi, addr, sizeof(hi));
+    memcpy(&lo, (const char *) addr + sizeof(hi), sizeof(lo));
+    h = HostHash_mix(hi) ^ lo;
+  } else {
+    uint32_t a;
+    memcpy(&a, addr, sizeof(a));
+    h = a;
+  }
+  return HostHash_mix(h);
+}
+// v6 is self->v6, passed by callers that know it at compile time
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+static inline unsigned int HostHash_start (
+    const struct HostHash * restrict self, const void * restrict addr,
+    bool v6) {
+  return HostHash_hash(addr, v6) & self->mask;
+}
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2)))
+static inline const struct HostHashSlot *HostHash_next (
+    const struct HostHash * restrict self, const void * restrict addr,
+    unsigned int *i, bool v6) {
+  const size_t addr_size =
+    v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+  for (; self->slots[*i].used; *i = (*i + 1) & self->mask) {
+    const struct HostHashSlot *slot = self->slots + *i;
+    if (memcmp(&slot->addr, addr, addr_size) == 0) {
+      *i = (*i + 1) & self->mask;
+      return slot;
+    }
+  }
+  return NULL;
+}
+__attribute__((nonnull, access(read_only, 2)))
+void HostHash_insert (
+  struct HostHash * restrict self, const void * restrict addr,
+  unsigned int chain, unsigned char index);
+__attribute__((nonnull))
+void HostHash_destroy (struct HostHash *self);
+__attribute__((nonnull, warn_unused_result))
+int HostHash_init (struct HostHash *self, size_t n, bool v6);
+
+
+#endif /* HASH_H */
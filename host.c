@@ -1,4 +1,5 @@
 #include <endian.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -11,13 +12,83 @@
 #include "macro.h"
 #include "inet.h"
 #include "log.h"
+#include "probe.h"
 #include "rdnstun.h"
 #include "host.h"
 
 
-bool BaseFakeHost_isnull (const struct FakeHost * restrict self, bool v6) {
-  return v6 ?
-    IN6_IS_ADDR_UNSPECIFIED(&self->addr) : self->addr.s_addr == INADDR_ANY;
+struct ipicmp {
+  struct ip ip;
+  union {
+    char data[8];
+    struct {
+      struct icmphdr icmp;
+      struct ip orig_ip;
+      char orig_data[8];
+    };
+  };
+};
+
+struct ipicmp6 {
+  struct ip6_hdr ip;
+  union {
+    char data[8];
+    struct {
+      struct icmp6_hdr icmp;
+      struct ip6_hdr orig_ip;
+      char orig_data[8];
+    };
+  };
+};
+
+
+// raw arguments of the debug message of a reply, formatted by the log thread
+struct FakeHostLogRecord {
+  unsigned char src[sizeof(struct in6_addr)];
+  unsigned char dst[sizeof(struct in6_addr)];
+  unsigned char ttl;
+  unsigned char receive_ttl;
+  bool dst_is_target;
+  bool v6;
+};
+
+
+static int FakeHostLogRecord_format (
+    struct LoggerEvent * __restrict event, const void * __restrict data) {
+  const struct FakeHostLogRecord *record = data;
+  int af = record->v6 ? AF_INET6 : AF_INET;
+  char s_src_addr[INET6_ADDRSTRLEN];
+  char s_dst_addr[INET6_ADDRSTRLEN];
+  inet_ntop(af, record->src, s_src_addr, sizeof(s_src_addr));
+  inet_ntop(af, record->dst, s_dst_addr, sizeof(s_dst_addr));
+  if (record->dst_is_target) {
+    return LoggerEvent_log(
+      event, "%s %d -> %s %d (%d)", s_src_addr, record->ttl, s_dst_addr,
+      record->receive_ttl, record->ttl);
+  }
+  return LoggerEvent_log(
+    event, "%s %d -> %s %d (%s %d)", s_src_addr, record->ttl, s_dst_addr,
+    record->receive_ttl, s_src_addr, record->ttl);
+}
+
+
+uint32_t BaseFakeHost_sum (const void *addr, bool v6) {
+  if (v6) {
+    // source, upper-layer length and next header of the pseudo-header
+    return inet_cksum_continue(
+      htons(sizeof(struct ipicmp6) - sizeof(struct ip6_hdr)) +
+      htons(IPPROTO_ICMPV6), addr, sizeof(struct in6_addr));
+  } else {
+    // length and source of the outer header
+    return inet_cksum_continue(
+      htons(sizeof(struct ipicmp)), addr, sizeof(struct in_addr));
+  }
+}
+
+
+void BaseFakeHost_prepare (
+    struct FakeHost * restrict self, const void * restrict addr, bool v6) {
+  self->reply_sum = BaseFakeHost_sum(addr, v6);
 }
 
 
@@ -28,6 +99,7 @@ int BaseFakeHost_init (
   self->mtu = mtu;
   memcpy(&self->addr, addr,
          v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
+  BaseFakeHost_prepare(self, addr, v6);
   return 0;
 }
 
@@ -35,40 +107,23 @@ int BaseFakeHost_init (
 int FakeHost_reply (
     const struct FakeHost * restrict self, unsigned char ttl,
     void *packet, unsigned short *len) {
-  struct ipicmp {
-    struct ip ip;
-    union {
-      char data[8];
-      struct {
-        struct icmphdr icmp;
-        struct ip orig_ip;
-        char orig_data[8];
-      };
-    };
-  } *pkt = packet;
+  struct ipicmp *pkt = packet;
 
   return_if_fail (pkt->ip.ip_ttl > ttl) 1;
+  const struct ip receive_ip = pkt->ip;
 
   // find reply host
   unsigned char receive_ttl = pkt->ip.ip_ttl - ttl;
   bool dst_is_target = self->addr.s_addr == pkt->ip.ip_dst.s_addr;
 
-  LOGEVENT (LOG_LEVEL_DEBUG) {
-    char s_src_addr[INET_ADDRSTRLEN];
-    char s_dst_addr[INET_ADDRSTRLEN];
-    inet_ntop(AF_INET, &pkt->ip.ip_src, s_src_addr, sizeof(s_src_addr));
-    inet_ntop(AF_INET, &pkt->ip.ip_dst, s_dst_addr, sizeof(s_dst_addr));
-    if (dst_is_target) {
-      LOGEVENT_LOG("%s %d -> %s %d (%d)",
-                   s_src_addr, pkt->ip.ip_ttl, s_dst_addr, receive_ttl,
-                   pkt->ip.ip_ttl);
-    } else {
-      char s_self_addr[INET_ADDRSTRLEN];
-      inet_ntop(AF_INET, &pkt->ip.ip_src, s_self_addr, sizeof(s_self_addr));
-      LOGEVENT_LOG("%s %d -> %s %d (%s %d)",
-                   s_src_addr, pkt->ip.ip_ttl, s_dst_addr, receive_ttl,
-                   s_self_addr, pkt->ip.ip_ttl);
-    }
+  if (LOG_WOULD_LOG(LOG_LEVEL_DEBUG)) {
+    struct FakeHostLogRecord record = {
+      .ttl = pkt->ip.ip_ttl, .receive_ttl = receive_ttl,
+      .dst_is_target = dst_is_target, .v6 = false,
+    };
+    memcpy(record.src, &pkt->ip.ip_src, sizeof(struct in_addr));
+    memcpy(record.dst, &pkt->ip.ip_dst, sizeof(struct in_addr));
+    LOG_DEFER(LOG_LEVEL_DEBUG, FakeHostLogRecord_format, &record);
   }
 
   // prepare reply
@@ -89,16 +144,24 @@ int FakeHost_reply (
       return 0;
     }
     // ping
+    PROBE(reply_type, 4, &self->addr, ttl, ICMP_ECHOREPLY, 0);
     pkt->icmp.type = ICMP_ECHOREPLY;
     pkt->icmp.code = 0;
-    if (*len <= self->mtu) {
-      uint32_t checksum = pkt->icmp.checksum;
-      checksum += le16toh(ICMP_ECHO) - le16toh(ICMP_ECHOREPLY);
-      pkt->icmp.checksum = (checksum >> 16) + (checksum & 0xffff);
-    } else {
+    uint32_t checksum = pkt->icmp.checksum;
+    checksum += le16toh(ICMP_ECHO) - le16toh(ICMP_ECHOREPLY);
+    pkt->icmp.checksum = (checksum >> 16) + (checksum & 0xffff);
+    if (*len > self->mtu) {
+      unsigned short icmp_len = *len - sizeof(struct ip);
+      unsigned short new_icmp_len = self->mtu - sizeof(struct ip);
+      // sum whichever part is shorter
+      if (new_icmp_len < icmp_len - new_icmp_len) {
+        inet_cksum(&pkt->icmp.checksum, &pkt->icmp, new_icmp_len);
+      } else {
+        pkt->icmp.checksum = inet_cksum_drop(
+          pkt->icmp.checksum, &pkt->icmp, icmp_len, new_icmp_len);
+      }
       *len = self->mtu;
       pkt->ip.ip_len = htons(*len);
-      inet_cksum(&pkt->icmp.checksum, &pkt->icmp, *len - sizeof(struct ip));
     }
     goto no_append;
   } else {
@@ -108,7 +171,17 @@ int FakeHost_reply (
   }
 
   // append new header
+  PROBE(reply_type, 4, &self->addr, ttl, type, code);
   *len = sizeof(struct ipicmp);
+  // the quoted part is still in place; the header may carry options or a
+  // bad checksum, so it does not always sum to zero
+  uint32_t quoted[(sizeof(struct ip) + sizeof(pkt->orig_data)) / 4];
+  memcpy(quoted, packet, sizeof(quoted));
+  uint64_t icmp_sum = (uint64_t) htons(type << 8 | code) +
+    quoted[0] + quoted[1] + quoted[2] + quoted[3] + quoted[4] + quoted[5] +
+    quoted[6];
+  icmp_sum = (icmp_sum >> 32) + (icmp_sum & 0xffffffff);
+  icmp_sum = (icmp_sum >> 32) + (icmp_sum & 0xffffffff);
   pkt->orig_ip = pkt->ip;
   memcpy(pkt->orig_data, pkt->data, sizeof(pkt->orig_data));
 
@@ -116,17 +189,40 @@ int FakeHost_reply (
   pkt->icmp.type = type;
   pkt->icmp.code = code;
   memset(&pkt->icmp.un, 0, sizeof(pkt->icmp.un));
-  inet_cksum(&pkt->icmp.checksum, &pkt->icmp,
-             sizeof(struct ipicmp) - sizeof(struct ip));
+  pkt->icmp.checksum = inet_cksum_finish(icmp_sum);
 
-  // fix ip header
+  // fix ip header, options of the received one are not kept
+  uint16_t words[sizeof(struct ip) / 2];
+  pkt->ip.ip_hl = sizeof(struct ip) >> 2;
   pkt->ip.ip_p = IPPROTO_ICMP;
   pkt->ip.ip_len = htons(sizeof(struct ipicmp));
+  pkt->ip.ip_ttl = self->ttl - ttl;
+  pkt->ip.ip_dst = pkt->ip.ip_src;
+  pkt->ip.ip_src = self->addr;
+  // length and source are in self->reply_sum
+  memcpy(words, &pkt->ip, sizeof(words));
+  pkt->ip.ip_sum = inet_cksum_finish(
+    self->reply_sum + words[0] + words[2] + words[3] + words[4] +
+    words[8] + words[9]);
+  return 0;
+
 no_append:
   pkt->ip.ip_ttl = self->ttl - ttl;
   pkt->ip.ip_dst = pkt->ip.ip_src;
   pkt->ip.ip_src = self->addr;
-  inet_cksum_header(&pkt->ip.ip_sum, pkt, sizeof(struct ip));
+
+  // only length, TTL and addresses may have changed, ip_sum is still the
+  // received one and cancels out
+  const unsigned char *old = (const unsigned char *) &receive_ip;
+  const unsigned char *new = packet;
+  uint32_t sum = (uint16_t) ~receive_ip.ip_sum;
+  sum = inet_cksum_replace(
+    sum, old + offsetof(struct ip, ip_len), new + offsetof(struct ip, ip_len),
+    sizeof(pkt->ip.ip_len));
+  sum = inet_cksum_replace(
+    sum, old + offsetof(struct ip, ip_ttl), new + offsetof(struct ip, ip_ttl),
+    sizeof(struct ip) - offsetof(struct ip, ip_ttl));
+  pkt->ip.ip_sum = inet_cksum_finish(sum);
 
   return 0;
 }
@@ -142,17 +238,7 @@ int FakeHost_init (
 int FakeHost6_reply (
     const struct FakeHost6 * restrict self, unsigned char ttl,
     void *packet, unsigned short *len) {
-  struct ipicmp6 {
-    struct ip6_hdr ip;
-    union {
-      char data[8];
-      struct {
-        struct icmp6_hdr icmp;
-        struct ip6_hdr orig_ip;
-        char orig_data[8];
-      };
-    };
-  } *pkt = packet;
+  struct ipicmp6 *pkt = packet;
 
   return_if_fail (pkt->ip.ip6_hlim > ttl) 1;
 
@@ -160,22 +246,14 @@ int FakeHost6_reply (
   unsigned char receive_ttl = pkt->ip.ip6_hlim - ttl;
   bool dst_is_target = IN6_ARE_ADDR_EQUAL(&self->addr, &pkt->ip.ip6_dst);
 
-  LOGEVENT (LOG_LEVEL_DEBUG) {
-    char s_src_addr[INET6_ADDRSTRLEN];
-    char s_dst_addr[INET6_ADDRSTRLEN];
-    inet_ntop(AF_INET6, &pkt->ip.ip6_src, s_src_addr, sizeof(s_src_addr));
-    inet_ntop(AF_INET6, &pkt->ip.ip6_dst, s_dst_addr, sizeof(s_dst_addr));
-    if (dst_is_target) {
-      LOGEVENT_LOG("%s %d -> %s %d (%d)",
-                   s_src_addr, pkt->ip.ip6_hlim, s_dst_addr, receive_ttl,
-                   pkt->ip.ip6_hlim);
-    } else {
-      char s_self_addr[INET6_ADDRSTRLEN];
-      inet_ntop(AF_INET6, &pkt->ip.ip6_src, s_self_addr, sizeof(s_self_addr));
-      LOGEVENT_LOG("%s %d -> %s %d (%s %d)",
-                   s_src_addr, pkt->ip.ip6_hlim, s_dst_addr, receive_ttl,
-                   s_self_addr, pkt->ip.ip6_hlim);
-    }
+  if (LOG_WOULD_LOG(LOG_LEVEL_DEBUG)) {
+    struct FakeHostLogRecord record = {
+      .ttl = pkt->ip.ip6_hlim, .receive_ttl = receive_ttl,
+      .dst_is_target = dst_is_target, .v6 = true,
+    };
+    memcpy(record.src, &pkt->ip.ip6_src, sizeof(struct in6_addr));
+    memcpy(record.dst, &pkt->ip.ip6_dst, sizeof(struct in6_addr));
+    LOG_DEFER(LOG_LEVEL_DEBUG, FakeHostLogRecord_format, &record);
   }
 
   // prepare reply
@@ -197,16 +275,31 @@ int FakeHost6_reply (
       return 0;
     }
     // ping
+    PROBE(reply_type, 6, &self->addr, ttl, ICMP6_ECHO_REPLY, 0);
     pkt->icmp.icmp6_type = ICMP6_ECHO_REPLY;
     pkt->icmp.icmp6_code = 0;
-    if (*len <= self->mtu) {
-      uint32_t checksum = pkt->icmp.icmp6_cksum;
-      checksum += le16toh(ICMP6_ECHO_REQUEST) - le16toh(ICMP6_ECHO_REPLY);
-      pkt->icmp.icmp6_cksum = (checksum >> 16) + (checksum & 0xffff);
-      checksum_ok = true;
-    } else {
+    uint32_t checksum = pkt->icmp.icmp6_cksum;
+    checksum += le16toh(ICMP6_ECHO_REQUEST) - le16toh(ICMP6_ECHO_REPLY);
+    pkt->icmp.icmp6_cksum = (checksum >> 16) + (checksum & 0xffff);
+    // source and destination are the same addresses swapped
+    checksum_ok = true;
+    if (*len > self->mtu) {
+      unsigned short icmp_len = *len - sizeof(struct ip6_hdr);
+      unsigned short new_icmp_len = self->mtu - sizeof(struct ip6_hdr);
+      uint16_t plen = pkt->ip.ip6_plen;
       *len = self->mtu;
-      pkt->ip.ip6_plen = htons(*len - sizeof(struct ip6_hdr));
+      pkt->ip.ip6_plen = htons(new_icmp_len);
+      // sum whichever part is shorter
+      if (new_icmp_len < icmp_len - new_icmp_len) {
+        checksum_ok = false;
+      } else {
+        uint32_t sum = (uint16_t) ~inet_cksum_drop(
+          pkt->icmp.icmp6_cksum, &pkt->icmp, icmp_len, new_icmp_len);
+        // upper-layer packet length in pseudo-header
+        sum = inet_cksum_replace(
+          sum, &plen, &pkt->ip.ip6_plen, sizeof(plen));
+        pkt->icmp.icmp6_cksum = inet_cksum_finish(sum);
+      }
     }
     goto no_append;
   } else {
@@ -216,6 +309,7 @@ int FakeHost6_reply (
   }
 
   // append new header
+  PROBE(reply_type, 6, &self->addr, ttl, type, code);
   *len = sizeof(struct ipicmp6);
   pkt->orig_ip = pkt->ip;
   memcpy(pkt->orig_data, pkt->data, sizeof(pkt->orig_data));
@@ -223,11 +317,24 @@ int FakeHost6_reply (
   // fix icmp header
   pkt->icmp.icmp6_type = type;
   pkt->icmp.icmp6_code = code;
+  pkt->icmp.icmp6_cksum = 0;
   memset(&pkt->icmp.icmp6_dataun, 0, sizeof(pkt->icmp.icmp6_dataun));
 
   // fix ip header
   pkt->ip.ip6_plen = htons(sizeof(struct ipicmp6) - sizeof(struct ip6_hdr));
   pkt->ip.ip6_nxt = IPPROTO_ICMPV6;
+  pkt->ip.ip6_hlim = self->ttl - ttl;
+  pkt->ip.ip6_dst = pkt->ip.ip6_src;
+  pkt->ip.ip6_src = self->addr;
+  // the rest of the pseudo-header is in self->reply_sum
+  uint32_t sum = inet_cksum_continue(
+    self->reply_sum, &pkt->ip.ip6_dst, sizeof(struct in6_addr));
+  sum = inet_cksum_continue(
+    sum, (const char *) packet + sizeof(struct ip6_hdr),
+    sizeof(struct ipicmp6) - sizeof(struct ip6_hdr));
+  pkt->icmp.icmp6_cksum = inet_cksum_finish(sum);
+  return 0;
+
 no_append:
   pkt->ip.ip6_hlim = self->ttl - ttl;
   pkt->ip.ip6_dst = pkt->ip.ip6_src;
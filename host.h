@@ -1,18 +1,34 @@
 #ifndef HOST_H
 #define HOST_H
 
+#include <stdbool.h>
+#include <stdint.h>
 #include <netinet/ip.h>
 #include <netinet/ip6.h>
 
 
+// fields of a host not compared on lookup, stored apart from its address
+struct FakeHostInfo {
+  uint32_t reply_sum;
+  unsigned short mtu;
+  unsigned char ttl;
+};
+
 struct FakeHost {
   unsigned char ttl;
   unsigned short mtu;
+  // partial sum over the constant fields of an error reply
+  uint32_t reply_sum;
   struct in_addr addr;
 };
 
+// partial sum of a host with address addr
 __attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
-bool BaseFakeHost_isnull (const struct FakeHost * restrict self, bool v6);
+uint32_t BaseFakeHost_sum (const void *addr, bool v6);
+// addr is the address of self, as the right type for either version
+__attribute__((nonnull, access(read_only, 2)))
+void BaseFakeHost_prepare (
+  struct FakeHost * restrict self, const void * restrict addr, bool v6);
 __attribute__((nonnull, access(read_only, 2)))
 int BaseFakeHost_init (
   struct FakeHost * restrict self, const void * restrict addr,
@@ -32,6 +48,7 @@ int FakeHost_init (
 struct FakeHost6 {
   unsigned char ttl;
   unsigned short mtu;
+  uint32_t reply_sum;
   struct in6_addr addr;
 };
 
@@ -0,0 +1,395 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/ip.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "macro.h"
+#include "utils.h"
+#include "host.h"
+#include "chain.h"
+#include "hash.h"
+#include "trie.h"
+#include "table.h"
+#include "image.h"
+
+
+#define TABLEIMAGE_BYTE_ORDER 0x0102
+
+
+static const struct TableImageHeader TableImage_native = {
+  .magic = TABLEIMAGE_MAGIC,
+  .version = TABLEIMAGE_VERSION,
+  .byte_order = TABLEIMAGE_BYTE_ORDER,
+  .chain_size = sizeof(struct HostChain),
+  .info_size = sizeof(struct FakeHostInfo),
+  .host_align = HOSTCHAIN_ALIGN,
+  .slot_size = sizeof(struct HostHashSlot),
+  .node_size = sizeof(struct RouteTrieNode),
+  .entry_size = sizeof(struct RouteTrieEntry),
+  .jump_size = sizeof(struct RouteTrieJump),
+};
+
+
+static int TableImage_append (
+    FILE *f, uint64_t *offset, const void *buf, size_t size) {
+  return_if_fail (fwrite(buf, 1, size, f) == size) -1;
+  *offset += size;
+  return 0;
+}
+
+
+// start a new section of size bytes
+static int TableImage_align (
+    FILE *f, uint64_t *offset, struct TableImageSection *section,
+    size_t size) {
+  static const char zeros[TABLEIMAGE_ALIGN] = {0};
+  return_nonzero (TableImage_append(
+    f, offset, zeros, -*offset % TABLEIMAGE_ALIGN));
+  section->offset = *offset;
+  section->size = size;
+  return 0;
+}
+
+
+static int TableImage_put (
+    FILE *f, uint64_t *offset, const void *buf, size_t size,
+    struct TableImageSection *section) {
+  return_nonzero (TableImage_align(f, offset, section, size));
+  return TableImage_append(f, offset, buf, size);
+}
+
+
+// chain records, with hosts replaced by their offset in the hosts section
+static int TableImage_put_chains (
+    FILE *f, uint64_t *offset, const struct HostChain *chains,
+    unsigned int n, uint64_t *host_offset, struct TableImageSection *section) {
+  return_nonzero (TableImage_align(
+    f, offset, section, sizeof(struct HostChain) * n));
+  for (unsigned int i = 0; i < n; i++) {
+    struct HostChain record;
+    memcpy(&record, chains + i, sizeof(record));
+    record._buf = (char *) (uintptr_t) *host_offset;
+    record.in_arena = false;
+    return_nonzero (TableImage_append(f, offset, &record, sizeof(record)));
+    *host_offset += HostChain_size(chains[i].len, chains[i].v6);
+  }
+  return 0;
+}
+
+
+static int TableImage_put_table (
+    FILE *f, uint64_t *offset, const struct HostChainTable *table,
+    struct TableImageTable *record) {
+  record->present = 1;
+  record->nchain = table->nchain;
+  record->nvchain = table->nvchain;
+
+  uint64_t host_offset = 0;
+  return_nonzero (TableImage_put_chains(
+    f, offset, table->chains, table->nchain, &host_offset, &record->chains));
+  return_nonzero (TableImage_put_chains(
+    f, offset, table->vchains, table->nvchain, &host_offset,
+    &record->vchains));
+
+  // hosts of all chains back to back, in sorted chain order
+  return_nonzero (TableImage_align(f, offset, &record->hosts, host_offset));
+  for (unsigned int i = 0; i < table->nchain + table->nvchain; i++) {
+    const struct HostChain *chain = i < table->nchain ?
+      table->chains + i : table->vchains + i - table->nchain;
+    return_nonzero (TableImage_append(
+      f, offset, chain->_buf, HostChain_size(chain->len, chain->v6)));
+  }
+
+  record->hash_mask = table->hash.mask;
+  return_nonzero (TableImage_put(
+    f, offset, table->hash.slots,
+    sizeof(struct HostHashSlot) * ((size_t) table->hash.mask + 1),
+    &record->hash));
+
+  const struct RouteTrie *trie = &table->trie;
+  record->trie_width = trie->width;
+  record->trie_jump_prefix = trie->jump_prefix;
+  record->trie_stride = trie->stride;
+  record->trie_nnode = trie->nnode;
+  return_nonzero (TableImage_put(
+    f, offset, trie->nodes, sizeof(struct RouteTrieNode) * trie->nnode,
+    &record->trie_nodes));
+  return_nonzero (TableImage_put(
+    f, offset, trie->entries, sizeof(struct RouteTrieEntry) * trie->nnode,
+    &record->trie_entries));
+  return TableImage_put(
+    f, offset, trie->jump,
+    trie->stride > 0 ? sizeof(struct RouteTrieJump) << trie->stride : 0,
+    &record->trie_jump);
+}
+
+
+int TableImage_write (
+    const char *path, const struct HostChainTable *v4,
+    const struct HostChainTable *v6) {
+  // replace atomically, running instances may still map the old file
+  char tmp_path[PATH_MAX];
+  return_if_fail (snprintf(
+    tmp_path, sizeof(tmp_path), "%s.tmp", path) < (int) sizeof(tmp_path)) -1;
+  FILE *f = fopen(tmp_path, "wb");
+  return_if_fail (f != NULL) -1;
+
+  struct TableImageHeader header = TableImage_native;
+  uint64_t offset = 0;
+  int ret;
+  goto_nonzero (
+    TableImage_append(f, &offset, &header, sizeof(header))) fail;
+  if (v4 != NULL) {
+    goto_nonzero (
+      TableImage_put_table(f, &offset, v4, &header.tables[0])) fail;
+  }
+  if (v6 != NULL) {
+    goto_nonzero (
+      TableImage_put_table(f, &offset, v6, &header.tables[1])) fail;
+  }
+  // now that the sections are known
+  test_goto (fseek(f, 0, SEEK_SET) == 0, -1) fail;
+  test_goto (fwrite(&header, sizeof(header), 1, f) == 1, -1) fail;
+  test_goto (fflush(f) == 0 && fsync(fileno(f)) == 0, -1) fail;
+  test_goto (fclose(f) == 0, -1) fail_unlink;
+  test_goto (rename(tmp_path, path) == 0, -1) fail_unlink;
+  return 0;
+
+fail:
+  fclose(f);
+fail_unlink:
+  unlink(tmp_path);
+  return ret;
+}
+
+
+const char *TableImage_strerror (int errnum) {
+  switch (errnum) {
+    case 1:
+      return "not a compiled table";
+    case 2:
+      return "compiled by another version";
+    case 3:
+      return "compiled on another architecture";
+    case 4:
+      return "file is corrupted";
+    default:
+      return Struct_strerror(errnum);
+  }
+}
+
+
+void TableImage_destroy (struct TableImage *self) {
+  munmap((void *) self->base, self->size);
+}
+
+
+static bool TableImage_has (
+    const struct TableImage *self, const struct TableImageSection *section,
+    size_t size) {
+  return section->offset % TABLEIMAGE_ALIGN == 0 &&
+         section->offset <= self->size &&
+         self->size - section->offset >= section->size &&
+         section->size == size;
+}
+
+
+// copy chain records out of the image and point them at its hosts
+static struct HostChain *TableImage_chains (
+    const struct TableImage *self, const struct TableImageTable *record,
+    const struct TableImageSection *section, unsigned int n, bool v6,
+    bool virtual) {
+  const unsigned char width = v6 ? 128 : 32;
+  struct HostChain *chains = malloc(sizeof(struct HostChain) * (n + 1));
+  return_if_fail (chains != NULL) NULL;
+  memcpy(chains, self->base + section->offset, sizeof(struct HostChain) * n);
+  memset(chains + n, 0, sizeof(struct HostChain));
+  for (unsigned int i = 0; i < n; i++) {
+    struct HostChain *chain = chains + i;
+    uint64_t offset = (uintptr_t) chain->_buf;
+    should (chain->v6 == v6 && chain->len > 0 && chain->prefix <= width &&
+            chain->dup_prefix <= width && (chain->ndup > 1) == virtual &&
+            (!virtual || chain->dup_step > 0) &&
+            offset % HOSTCHAIN_ALIGN == 0 && offset <= record->hosts.size &&
+            record->hosts.size - offset >=
+              HostChain_size(chain->len, v6)) otherwise {
+      free(chains);
+      errno = 0;
+      return NULL;
+    }
+    chain->_buf = (char *) self->base + record->hosts.offset + offset;
+    chain->in_arena = true;
+  }
+  return chains;
+}
+
+
+// indexes are followed without checks on lookup, so check them once here
+static bool TableImage_check (const struct HostChainTable *table) {
+  unsigned int nused = 0;
+  for (unsigned int i = 0; i <= table->hash.mask; i++) {
+    const struct HostHashSlot *slot = table->hash.slots + i;
+    continue_if_not (slot->used);
+    nused++;
+    return_if_fail (slot->chain < table->nchain) false;
+    return_if_fail (slot->index < table->chains[slot->chain].len) false;
+  }
+  // probing stops at an empty slot
+  return_if_fail (nused <= table->hash.mask) false;
+
+  const struct RouteTrie *trie = &table->trie;
+  return_if_fail (trie->nnode > 0 && trie->nodes[0].prefix == 0) false;
+  for (unsigned int i = 0; i < trie->nnode; i++) {
+    const struct RouteTrieNode *node = trie->nodes + i;
+    const struct RouteTrieEntry *entry = trie->entries + i;
+    return_if_fail (node->prefix <= trie->width) false;
+    // descending always goes deeper, and ascending shallower
+    for (unsigned int j = 0; j < 2; j++) {
+      return_if_fail (node->child[j] == 0 || (
+        node->child[j] < trie->nnode &&
+        trie->nodes[node->child[j]].prefix > node->prefix)) false;
+    }
+    return_if_fail (entry->parent == ROUTETRIE_NONE || (
+      entry->parent < trie->nnode &&
+      trie->nodes[entry->parent].prefix < node->prefix)) false;
+    return_if_fail (!node->entry || entry->value < table->nchain) false;
+  }
+  for (unsigned int i = 0; trie->stride > 0 && i < 1u << trie->stride; i++) {
+    const struct RouteTrieJump *jump = trie->jump + i;
+    return_if_fail (jump->node < trie->nnode) false;
+    return_if_fail (
+      jump->best == ROUTETRIE_NONE || jump->best < trie->nnode) false;
+  }
+  return true;
+}
+
+
+static int TableImage_table (
+    const struct TableImage *self, const struct TableImageTable *record,
+    struct HostChainTable *table, bool v6) {
+  return_if_fail (record->trie_width == (v6 ? 128 : 32) &&
+                  record->trie_stride <= ROUTETRIE_MAX_STRIDE &&
+                  record->trie_jump_prefix <= record->trie_width &&
+                  (record->hash_mask & (record->hash_mask + 1)) == 0) 4;
+  return_if_fail (
+    TableImage_has(self, &record->chains,
+                   sizeof(struct HostChain) * record->nchain) &&
+    TableImage_has(self, &record->vchains,
+                   sizeof(struct HostChain) * record->nvchain) &&
+    TableImage_has(self, &record->hosts, record->hosts.size) &&
+    TableImage_has(self, &record->hash, sizeof(struct HostHashSlot) * (
+      (size_t) record->hash_mask + 1)) &&
+    TableImage_has(self, &record->trie_nodes,
+                   sizeof(struct RouteTrieNode) * record->trie_nnode) &&
+    TableImage_has(self, &record->trie_entries,
+                   sizeof(struct RouteTrieEntry) * record->trie_nnode) &&
+    TableImage_has(self, &record->trie_jump, record->trie_stride > 0 ?
+      sizeof(struct RouteTrieJump) << record->trie_stride : 0)) 4;
+
+  table->chains = TableImage_chains(
+    self, record, &record->chains, record->nchain, v6, false);
+  return_if_fail (table->chains != NULL) errno == 0 ? 4 : -1;
+  table->vchains = TableImage_chains(
+    self, record, &record->vchains, record->nvchain, v6, true);
+  should (table->vchains != NULL) otherwise {
+    int ret = errno == 0 ? 4 : -1;
+    free(table->chains);
+    table->chains = NULL;
+    return ret;
+  }
+  table->nchain = record->nchain;
+  table->nvchain = record->nvchain;
+  table->v6 = v6;
+
+  table->hash.slots = (void *) (self->base + record->hash.offset);
+  table->hash.mask = record->hash_mask;
+  table->hash.v6 = v6;
+
+  table->trie.nodes = (void *) (self->base + record->trie_nodes.offset);
+  table->trie.entries = (void *) (self->base + record->trie_entries.offset);
+  table->trie.jump = record->trie_stride > 0 ?
+    (void *) (self->base + record->trie_jump.offset) : NULL;
+  table->trie.nnode = record->trie_nnode;
+  table->trie.cap = record->trie_nnode;
+  table->trie.width = record->trie_width;
+  table->trie.jump_prefix = record->trie_jump_prefix;
+  table->trie.stride = record->trie_stride;
+
+  table->filter.words = NULL;
+#ifndef NO_DIR24
+  table->dir.tbl24 = NULL;
+#endif
+  table->mapped = true;
+  table->generation = HostChainTable_next_generation();
+  should (TableImage_check(table)) otherwise {
+    HostChainTable_destroy(table);
+    table->chains = NULL;
+    return 4;
+  }
+  // cheap to rebuild, so not part of the image
+  should (HostChainTable_init_index(table) == 0) otherwise {
+    HostChainTable_destroy(table);
+    table->chains = NULL;
+    return -1;
+  }
+  return 0;
+}
+
+
+int TableImage_init (
+    struct TableImage * restrict self, const char * restrict path,
+    struct HostChainTable * restrict v4, struct HostChainTable * restrict v6) {
+  v4->chains = NULL;
+  v6->chains = NULL;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  return_if_fail (fd >= 0) -1;
+  struct stat st;
+  should (fstat(fd, &st) == 0) otherwise {
+    close(fd);
+    return -1;
+  }
+  should (st.st_size >= (off_t) sizeof(struct TableImageHeader)) otherwise {
+    close(fd);
+    return 1;
+  }
+  self->size = st.st_size;
+  // shared with every other instance serving the same file
+  self->base = mmap(NULL, self->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return_if_fail (self->base != MAP_FAILED) -1;
+
+  int ret;
+  const struct TableImageHeader *header = (const void *) self->base;
+  test_goto (header->magic == TABLEIMAGE_MAGIC, 1) fail;
+  test_goto (header->version == TABLEIMAGE_VERSION, 2) fail;
+  struct TableImageHeader layout = *header;
+  memset(layout.tables, 0, sizeof(layout.tables));
+  test_goto (memcmp(
+    &layout, &TableImage_native, sizeof(layout)) == 0, 3) fail;
+
+  if (header->tables[0].present) {
+    goto_nonzero (
+      TableImage_table(self, &header->tables[0], v4, false)) fail;
+  }
+  if (header->tables[1].present) {
+    goto_nonzero (TableImage_table(self, &header->tables[1], v6, true)) fail;
+  }
+  test_goto (v4->chains != NULL || v6->chains != NULL, 4) fail;
+  return 0;
+
+fail:
+  if (v4->chains != NULL) {
+    HostChainTable_destroy(v4);
+    v4->chains = NULL;
+  }
+  TableImage_destroy(self);
+  return ret;
+}
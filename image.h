@@ -0,0 +1,80 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// #include "table.h"
+struct HostChainTable;
+
+
+#define TABLEIMAGE_MAGIC 0x4c425452  /* "RTBL" */
+#define TABLEIMAGE_VERSION 3
+// sections start on their own cache line
+#define TABLEIMAGE_ALIGN 64
+
+
+struct TableImageSection {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct TableImageTable {
+  uint8_t present;
+  uint8_t trie_width;
+  uint8_t trie_jump_prefix;
+  uint8_t trie_stride;
+  uint32_t nchain;
+  uint32_t nvchain;
+  uint32_t hash_mask;
+  uint32_t trie_nnode;
+  uint32_t reserved;
+  // chain records hold the offset of their hosts in the hosts section
+  struct TableImageSection chains;
+  struct TableImageSection vchains;
+  struct TableImageSection hosts;
+  struct TableImageSection hash;
+  struct TableImageSection trie_nodes;
+  struct TableImageSection trie_entries;
+  struct TableImageSection trie_jump;
+};
+
+// everything is stored in native layout, so check it matches
+struct TableImageHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint16_t byte_order;
+  uint16_t chain_size;
+  uint16_t info_size;
+  uint16_t host_align;
+  uint16_t slot_size;
+  uint16_t node_size;
+  uint16_t entry_size;
+  uint16_t jump_size;
+  // v4, v6
+  struct TableImageTable tables[2];
+};
+
+// a read-only mapping of a compiled table file
+struct TableImage {
+  const char *base;
+  size_t size;
+};
+
+
+__attribute__((nonnull(1), warn_unused_result, access(read_only, 1)))
+int TableImage_write (
+  const char *path, const struct HostChainTable *v4,
+  const struct HostChainTable *v6);
+__attribute__((const, warn_unused_result))
+const char *TableImage_strerror (int errnum);
+__attribute__((nonnull))
+void TableImage_destroy (struct TableImage *self);
+// tables have chains == NULL if absent; they borrow from the image
+__attribute__((nonnull, warn_unused_result, access(read_only, 2)))
+int TableImage_init (
+  struct TableImage * restrict self, const char * restrict path,
+  struct HostChainTable * restrict v4, struct HostChainTable * restrict v6);
+
+
+#endif /* IMAGE_H */
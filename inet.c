@@ -10,7 +10,12 @@
 #include "inet.h"
 
 
-uint32_t inet_cksum_continue (uint32_t sum, const void *buf, size_t count) {
+// 32-bit lanes take up to two words per step, flush before they overflow
+#define INET_CKSUM_CHUNK 16384
+
+
+static inline uint32_t inet_cksum_continue_scalar (
+    uint32_t sum, const void *buf, size_t count) {
   const uint16_t *addr = buf;
 
   // Main summing loop
@@ -28,6 +33,160 @@ uint32_t inet_cksum_continue (uint32_t sum, const void *buf, size_t count) {
 }
 
 
+// all engines add the same words with exact integers, so the result is
+// bit-identical to the scalar loop
+
+static uint32_t inet_cksum_continue_generic (
+    uint32_t sum, const void *buf, size_t count) {
+  const unsigned char *p = buf;
+  uint64_t total = 0;
+  while (count >= 8) {
+    // four words in two 32-bit halves each
+    uint64_t even = 0;
+    uint64_t odd = 0;
+    size_t n = min(count / 8, INET_CKSUM_CHUNK);
+    for (size_t i = 0; i < n; i++, p += 8) {
+      uint64_t x;
+      memcpy(&x, p, sizeof(x));
+      even += x & 0x0000ffff0000ffff;
+      odd += (x >> 16) & 0x0000ffff0000ffff;
+    }
+    count -= n * 8;
+    total += (even >> 32) + (even & 0xffffffff) +
+             (odd >> 32) + (odd & 0xffffffff);
+  }
+  return inet_cksum_continue_scalar(sum + (uint32_t) total, p, count);
+}
+
+
+#if defined __x86_64__ || defined __i386__
+#include <immintrin.h>
+
+__attribute__((target("sse2")))
+static uint32_t inet_cksum_continue_sse2 (
+    uint32_t sum, const void *buf, size_t count) {
+  const unsigned char *p = buf;
+  const __m128i zero = _mm_setzero_si128();
+  uint64_t total = 0;
+  while (count >= 16) {
+    __m128i lo = zero;
+    __m128i hi = zero;
+    size_t n = min(count / 16, INET_CKSUM_CHUNK);
+    for (size_t i = 0; i < n; i++, p += 16) {
+      __m128i x = _mm_loadu_si128((const __m128i *) p);
+      lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(x, zero));
+      hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(x, zero));
+    }
+    count -= n * 16;
+    uint32_t lanes[8];
+    _mm_storeu_si128((__m128i *) lanes, lo);
+    _mm_storeu_si128((__m128i *) (lanes + 4), hi);
+    for (unsigned int i = 0; i < 8; i++) {
+      total += lanes[i];
+    }
+  }
+  return inet_cksum_continue_scalar(sum + (uint32_t) total, p, count);
+}
+
+
+__attribute__((target("avx2")))
+static uint32_t inet_cksum_continue_avx2 (
+    uint32_t sum, const void *buf, size_t count) {
+  const unsigned char *p = buf;
+  const __m256i zero = _mm256_setzero_si256();
+  uint64_t total = 0;
+  while (count >= 32) {
+    __m256i lo = zero;
+    __m256i hi = zero;
+    size_t n = min(count / 32, INET_CKSUM_CHUNK);
+    for (size_t i = 0; i < n; i++, p += 32) {
+      __m256i x = _mm256_loadu_si256((const __m256i *) p);
+      lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(x, zero));
+      hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(x, zero));
+    }
+    count -= n * 32;
+    uint32_t lanes[16];
+    _mm256_storeu_si256((__m256i *) lanes, lo);
+    _mm256_storeu_si256((__m256i *) (lanes + 8), hi);
+    for (unsigned int i = 0; i < 16; i++) {
+      total += lanes[i];
+    }
+  }
+  // avoid the transition penalty in legacy SSE code of the caller
+  _mm256_zeroupper();
+  return inet_cksum_continue_scalar(sum + (uint32_t) total, p, count);
+}
+
+#elif defined __ARM_NEON && defined USE_NEON
+#include <arm_neon.h>
+
+static uint32_t inet_cksum_continue_neon (
+    uint32_t sum, const void *buf, size_t count) {
+  const unsigned char *p = buf;
+  uint64_t total = 0;
+  while (count >= 16) {
+    uint32x4_t acc = vdupq_n_u32(0);
+    size_t n = min(count / 16, INET_CKSUM_CHUNK);
+    for (size_t i = 0; i < n; i++, p += 16) {
+      acc = vpadalq_u16(acc, vreinterpretq_u16_u8(vld1q_u8(p)));
+    }
+    count -= n * 16;
+    uint32_t lanes[4];
+    vst1q_u32(lanes, acc);
+    for (unsigned int i = 0; i < 4; i++) {
+      total += lanes[i];
+    }
+  }
+  return inet_cksum_continue_scalar(sum + (uint32_t) total, p, count);
+}
+#endif
+
+
+static uint32_t (*inet_cksum_continue_engine) (
+  uint32_t sum, const void *buf, size_t count) = inet_cksum_continue_generic;
+
+
+__attribute__((constructor))
+static void inet_cksum_select (void) {
+#if defined __x86_64__ || defined __i386__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    inet_cksum_continue_engine = inet_cksum_continue_avx2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    inet_cksum_continue_engine = inet_cksum_continue_sse2;
+  }
+#elif defined __ARM_NEON && defined USE_NEON
+  inet_cksum_continue_engine = inet_cksum_continue_neon;
+#endif
+}
+
+
+uint32_t inet_cksum_continue (uint32_t sum, const void *buf, size_t count) {
+  return inet_cksum_continue_engine(sum, buf, count);
+}
+
+
+uint32_t inet_cksum_replace (
+    uint32_t sum, const void *old, const void *new, size_t count) {
+  // RFC 1624 eqn. 3: HC' = ~(~HC + ~m + m')
+  sum += inet_cksum_finish(inet_cksum_continue(0, old, count));
+  return inet_cksum_continue(sum, new, count);
+}
+
+
+uint16_t inet_cksum_drop (
+    uint16_t cksum, const void *buf, size_t count, size_t new_count) {
+  uint16_t tail = ~inet_cksum_finish(inet_cksum_continue(
+    0, (const char *) buf + new_count, count - new_count));
+  if (new_count % 2 != 0) {
+    // tail starts at the second byte of a 16-bit word
+    tail = (tail >> 8) | (tail << 8);
+  }
+  // dropping the tail is replacing it with zeros
+  return inet_cksum_finish((uint16_t) ~cksum + (uint16_t) ~tail);
+}
+
+
 uint16_t _inet_cksum (void *cksum, const void *buf, size_t count, int append) {
   uint16_t *ip_cksum = cksum;
   // first, set cksum to 0
@@ -118,7 +277,7 @@ int inet_isnetwork (int af, const void *network, unsigned int prefix) {
 }
 
 
-int inet_shift (int af, void *addr, int offset, unsigned int prefix) {
+int inet_shift (int af, void *addr, long long offset, unsigned int prefix) {
   unsigned short len = inet_size(af);
   return_if (len == 0) -1;
   should (prefix <= len) otherwise {
@@ -127,12 +286,12 @@ int inet_shift (int af, void *addr, int offset, unsigned int prefix) {
   }
 
   if (af == AF_INET) {
-    long long shift = (long long) offset << (32 - prefix);
+    uint32_t shift = (unsigned long long) offset << (32 - prefix);
     *(uint32_t *) addr = htonl(ntohl(*(uint32_t *) addr) + shift);
   } else {
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wpedantic"
-    __int128 shift = (__int128) offset << (128 - prefix);
+    __int128 shift = (unsigned __int128) offset << (128 - prefix);
 #if __BYTE_ORDER == __LITTLE_ENDIAN
     union in6_addr_ {
       uint32_t addr32[4];
@@ -158,3 +317,42 @@ int inet_shift (int af, void *addr, int offset, unsigned int prefix) {
   }
   return 0;
 }
+
+
+int inet_block (
+    int af, const void *addr, const void *base, unsigned int prefix,
+    unsigned int network_prefix, unsigned long long *block) {
+  unsigned short len = inet_size(af);
+  return_if (len == 0) -1;
+  should (prefix <= network_prefix && network_prefix <= len) otherwise {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (af == AF_INET) {
+    uint64_t diff = (uint32_t) (
+      ntohl(*(const uint32_t *) addr) - ntohl(*(const uint32_t *) base));
+    uint64_t rem = diff & ((UINT64_C(1) << (32 - prefix)) - 1);
+    return_if_not (rem >> (32 - network_prefix) == 0) 1;
+    *block = diff >> (32 - prefix);
+  } else {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+    unsigned __int128 a = 0;
+    unsigned __int128 b = 0;
+    for (unsigned int i = 0; i < sizeof(struct in6_addr); i++) {
+      a = (a << 8) | ((const uint8_t *) addr)[i];
+      b = (b << 8) | ((const uint8_t *) base)[i];
+    }
+    unsigned __int128 diff = a - b;
+    unsigned __int128 high = prefix == 0 ? 0 : diff >> (128 - prefix);
+    unsigned __int128 rem = prefix == 0 ? diff :
+      diff & (((unsigned __int128) 1 << (128 - prefix)) - 1);
+    return_if_not (
+      (network_prefix == 0 ? rem : rem >> (128 - network_prefix)) == 0) 1;
+    return_if_not (high >> 64 == 0) 1;
+    *block = high;
+#pragma GCC diagnostic pop
+  }
+  return 0;
+}
@@ -15,6 +15,12 @@ static inline uint16_t inet_cksum_finish (uint32_t sum) {
 
 __attribute__((nonnull, access(read_only, 2, 3)))
 uint32_t inet_cksum_continue (uint32_t sum, const void *buf, size_t count);
+__attribute__((nonnull, access(read_only, 2, 4), access(read_only, 3, 4)))
+uint32_t inet_cksum_replace (
+  uint32_t sum, const void *old, const void *new, size_t count);
+__attribute__((nonnull, access(read_only, 2, 3)))
+uint16_t inet_cksum_drop (
+  uint16_t cksum, const void *buf, size_t count, size_t new_count);
 __attribute__((nonnull, access(read_only, 2, 3)))
 uint16_t inet_cksum_header (void *cksum, const void *buf, size_t count);
 __attribute__((nonnull(2), access(read_only, 2, 3)))
@@ -24,7 +30,12 @@ int membcmp (const void *s1, const void *s2, size_t n);
 __attribute__((nonnull, pure, warn_unused_result, access(read_only, 2)))
 int inet_isnetwork (int af, const void *network, unsigned int prefix);
 __attribute__((nonnull))
-int inet_shift (int af, void *addr, int offset, unsigned int prefix);
+int inet_shift (int af, void *addr, long long offset, unsigned int prefix);
+__attribute__((nonnull, warn_unused_result, access(read_only, 2),
+               access(read_only, 3), access(write_only, 6)))
+int inet_block (
+  int af, const void *addr, const void *base, unsigned int prefix,
+  unsigned int network_prefix, unsigned long long *block);
 
 
 #endif /* INET_H */
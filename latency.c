@@ -0,0 +1,82 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined __x86_64__ || defined __i386__
+#include <cpuid.h>
+#endif
+
+#include "macro.h"
+#include "latency.h"
+
+
+bool latency_tsc = false;
+double latency_ns_per_tick = 1;
+
+
+static inline uint64_t latency_clock (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+void latency_init (void) {
+#if defined __x86_64__ || defined __i386__
+  unsigned int eax, ebx, ecx, edx;
+  return_if_not (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx));
+  // invariant TSC ticks at a constant rate across P- and C-states
+  return_if_not (edx & (1 << 8));
+
+  uint64_t t0 = latency_clock();
+  uint64_t c0 = __rdtsc();
+  nanosleep(&(struct timespec) {.tv_nsec = 10000000}, NULL);
+  uint64_t t1 = latency_clock();
+  uint64_t c1 = __rdtsc();
+  return_if_fail (c1 > c0 && t1 > t0);
+  latency_ns_per_tick = (double) (t1 - t0) / (c1 - c0);
+  latency_tsc = true;
+#endif
+}
+
+
+uint64_t LatencyHist_value (unsigned int index) {
+  return_if (index < 2 << LATENCYHIST_SUB_BITS) index;
+  unsigned int shift = (index >> LATENCYHIST_SUB_BITS) - 1;
+  uint64_t mantissa = index - (shift << LATENCYHIST_SUB_BITS);
+  return ((mantissa + 1) << shift) - 1;
+}
+
+
+uint64_t LatencyHist_total (const struct LatencyHist *self) {
+  uint64_t total = 0;
+  for (unsigned int i = 0; i < LATENCYHIST_SIZE; i++) {
+    total += __atomic_load_n(self->count + i, __ATOMIC_RELAXED);
+  }
+  return total;
+}
+
+
+uint64_t LatencyHist_percentile (const struct LatencyHist *self, double p) {
+  uint64_t total = LatencyHist_total(self);
+  return_if (total == 0) 0;
+  double rank = total * p / 100;
+  uint64_t target = rank;
+  if (target < rank || target == 0) {
+    target++;
+  }
+  uint64_t seen = 0;
+  for (unsigned int i = 0; i < LATENCYHIST_SIZE; i++) {
+    seen += __atomic_load_n(self->count + i, __ATOMIC_RELAXED);
+    return_if (seen >= target) LatencyHist_value(i);
+  }
+  return LatencyHist_value(LATENCYHIST_SIZE - 1);
+}
+
+
+void LatencyHist_merge (
+    struct LatencyHist * restrict self,
+    const struct LatencyHist * restrict src) {
+  for (unsigned int i = 0; i < LATENCYHIST_SIZE; i++) {
+    self->count[i] += __atomic_load_n(src->count + i, __ATOMIC_RELAXED);
+  }
+}
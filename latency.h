@@ -0,0 +1,73 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#if defined __x86_64__ || defined __i386__
+#include <x86intrin.h>
+#endif
+
+#include "macro.h"
+
+
+// 16 buckets per power of two, so values are off by at most 1/16
+#define LATENCYHIST_SUB_BITS 4
+// about 6 minutes in TSC ticks, larger values are clamped
+#define LATENCYHIST_MAX_BITS 40
+#define LATENCYHIST_SIZE \
+  ((LATENCYHIST_MAX_BITS - LATENCYHIST_SUB_BITS + 1) << LATENCYHIST_SUB_BITS)
+
+
+// TSC if invariant, otherwise CLOCK_MONOTONIC_RAW in ns
+extern bool latency_tsc;
+extern double latency_ns_per_tick;
+
+__attribute__((warn_unused_result))
+static inline uint64_t latency_now (void) {
+#if defined __x86_64__ || defined __i386__
+  return_if (likely(latency_tsc)) __rdtsc();
+#endif
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+void latency_init (void);
+
+
+/***/
+
+// log-linear, in ticks of latency_now()
+struct LatencyHist {
+  uint64_t count[LATENCYHIST_SIZE];
+};
+
+
+__attribute__((const, warn_unused_result))
+static inline unsigned int LatencyHist_index (uint64_t ticks) {
+  ticks = min(ticks, ((uint64_t) 1 << LATENCYHIST_MAX_BITS) - 1);
+  // the first two blocks are exact
+  unsigned int shift = 63 - __builtin_clzll(
+    ticks | ((2 << LATENCYHIST_SUB_BITS) - 1)) - LATENCYHIST_SUB_BITS;
+  return (shift << LATENCYHIST_SUB_BITS) + (ticks >> shift);
+}
+
+// one writer per histogram, readers may see it mid-update
+__attribute__((nonnull))
+static inline void LatencyHist_add (struct LatencyHist *self, uint64_t ticks) {
+  uint64_t *count = self->count + LatencyHist_index(ticks);
+  __atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+}
+
+__attribute__((const, warn_unused_result))
+uint64_t LatencyHist_value (unsigned int index);
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+uint64_t LatencyHist_total (const struct LatencyHist *self);
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+uint64_t LatencyHist_percentile (const struct LatencyHist *self, double p);
+__attribute__((nonnull, access(read_only, 2)))
+void LatencyHist_merge (
+  struct LatencyHist * restrict self, const struct LatencyHist * restrict src);
+
+
+#endif /* LATENCY_H */
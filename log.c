@@ -3,15 +3,19 @@
 #include <locale.h>
 #include <poll.h>
 #include <signal.h>
+#include <stdalign.h>
 #include <stdarg.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <termios.h>
+#include <threads.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/uio.h>
 
 #include "macro.h"
 #include "color.h"
@@ -28,13 +32,13 @@ extern inline bool Logger_would_log (
   const struct Logger * __restrict self, int level);
 
 extern inline int LoggerEvent_log_va_func (
-  const struct LoggerEvent * __restrict self,
+  struct LoggerEvent * __restrict self,
   const char * __restrict format, va_list ap);
 extern inline int LoggerEvent_write_func (
-  const struct LoggerEvent * __restrict self,
+  struct LoggerEvent * __restrict self,
   const char * __restrict str, size_t len);
 extern inline int LoggerEvent_puts_func (
-  const struct LoggerEvent * __restrict self, const char * __restrict str);
+  struct LoggerEvent * __restrict self, const char * __restrict str);
 extern inline int LoggerEvent_init_func (
   struct LoggerEvent * __restrict self,
   const struct Logger * __restrict logger, int level,
@@ -198,39 +202,52 @@ const char * const LogLevel_names[9] = {
  ******************************************************************************/
 
 
+// local time of the last second logged by this thread
+static thread_local time_t logger_time_cached = -1;
+static thread_local char logger_time_buf[32];
+static thread_local size_t logger_time_len;
+
+
 static int logger_stream_std_begin (
     struct LoggerEvent * __restrict self, const char * __restrict domain,
     unsigned char level, const char * __restrict file, int line,
     const char * __restrict func, const char * __restrict sgr) {
-  int ret;
-  int fd = self->stream->fd;
-
   time_t curtime = time(NULL);
-  struct tm timeinfo;
-  localtime_r(&curtime, &timeinfo);
-  char timebuf[64];
-  strftime(
-    timebuf, sizeof(timebuf), sgr != NULL ?
-      COLOR_SEQ(COLOR_FOREGROUND_GREEN) "[%b %e %T]" RESET_SEQ : "[%b %e %T]",
-    &timeinfo);
+  if unlikely (curtime != logger_time_cached) {
+    struct tm timeinfo;
+    localtime_r(&curtime, &timeinfo);
+    logger_time_len = strftime(
+      logger_time_buf, sizeof(logger_time_buf), "[%b %e %T]", &timeinfo);
+    logger_time_cached = curtime;
+  }
+
+  int ret = 0;
+  if (sgr != NULL) {
+    ret += LoggerEvent_puts_func(self, COLOR_SEQ(COLOR_FOREGROUND_GREEN));
+  }
+  ret += LoggerEvent_write_func(self, logger_time_buf, logger_time_len);
+  if (sgr != NULL) {
+    ret += LoggerEvent_puts_func(self, RESET_SEQ);
+  }
 
   if unlikely (file == NULL) {
-    ret = dprintf(fd, "%s: ", timebuf);
+    ret += LoggerEvent_write_func(self, ": ", 2);
   } else if unlikely (func == NULL) {
-    ret = dprintf(fd, "%s (%s:%d): ", timebuf, file, line);
+    ret += LoggerEvent_log_func(self, " (%s:%d): ", file, line);
   } else {
-    ret = dprintf(fd, "%s (%s:%d %s): ", timebuf, file, line, func);
+    ret += LoggerEvent_log_func(self, " (%s:%d %s): ", file, line, func);
   }
 
   if likely (domain != NULL) {
-    ret += dprintf(fd, "%s-", domain);
+    ret += LoggerEvent_puts_func(self, domain);
+    ret += LoggerEvent_write_func(self, "-", 1);
   }
   const char *level_name = LogLevel_names[level];
   if likely (sgr != NULL) {
-    ret += dprintf(fd, SGR_FORMAT_SEQ_START "%s" RESET_SEQ " **: ",
-                   sgr, level_name);
+    ret += LoggerEvent_log_func(
+      self, SGR_FORMAT_SEQ_START "%s" RESET_SEQ " **: ", sgr, level_name);
   } else {
-    ret += dprintf(fd, "%s **: ", level_name);
+    ret += LoggerEvent_log_func(self, "%s **: ", level_name);
   }
 
   return ret;
@@ -279,8 +296,29 @@ void Logger_set_stream (
  ******************************************************************************/
 
 
+int LoggerEvent_flush_func (
+    struct LoggerEvent * __restrict self, const char * __restrict str,
+    size_t len) {
+  int res;
+  if likely (len <= sizeof(self->buf) - self->len) {
+    if (len > 0) {
+      memcpy(self->buf + self->len, str, len);
+    }
+    res = write(self->stream->fd, self->buf, self->len + len);
+  } else {
+    struct iovec iov[2] = {
+      {.iov_base = self->buf, .iov_len = self->len},
+      {.iov_base = (void *) str, .iov_len = len},
+    };
+    res = writev(self->stream->fd, iov, arraysize(iov));
+  }
+  self->len = 0;
+  return res;
+}
+
+
 int LoggerEvent_log_func (
-    const struct LoggerEvent * __restrict self,
+    struct LoggerEvent * __restrict self,
     const char * __restrict format, ...) {
   va_list ap;
   va_start(ap, format);
@@ -291,7 +329,7 @@ int LoggerEvent_log_func (
 
 
 int LoggerEvent_perror_func (
-    const struct LoggerEvent * __restrict self, int errnum, bool colon) {
+    struct LoggerEvent * __restrict self, int errnum, bool colon) {
   if unlikely (errnum == 0) {
     errnum = errno;
   }
@@ -315,14 +353,15 @@ int LoggerEvent_perror_func (
 
 
 int LoggerEvent_backtrace_func (
-    const struct LoggerEvent * __restrict self, int skip) {
+    struct LoggerEvent * __restrict self, int skip) {
+  LoggerEvent_flush_func(self, NULL, 0);
   print_backtrace(self->stream->fd, self->skip + skip + 1, true);
   return 0;
 }
 
 
-int LoggerEvent_destroy_func (const struct LoggerEvent * __restrict self) {
-  int res = write(self->stream->fd, "\n", 1);
+int LoggerEvent_destroy_func (struct LoggerEvent * __restrict self) {
+  int res = LoggerEvent_flush_func(self, "\n", 1);
   if unlikely (self->backtrace) {
     print_backtrace(self->stream->fd, self->skip + 1, true);
   }
@@ -393,3 +432,268 @@ int Logger_log_perror_func (
   LOGGER_EVENT_GUARD_END(&event);
   return res;
 }
+
+
+/******************************************************************************
+ * Rate-limited log
+ ******************************************************************************/
+
+
+bool LoggerLimit_allow (
+    struct LoggerLimit * __restrict self, unsigned int burst, int interval,
+    unsigned long * __restrict suppressed) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+  long now = ts.tv_sec / interval;
+
+  *suppressed = 0;
+  long window = __atomic_load_n(&self->window, __ATOMIC_RELAXED);
+  if unlikely (now != window && __atomic_compare_exchange_n(
+      &self->window, &window, now, false,
+      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    // this one opens the interval
+    __atomic_store_n(&self->count, 1, __ATOMIC_RELAXED);
+    *suppressed = __atomic_exchange_n(&self->suppressed, 0, __ATOMIC_RELAXED);
+    return true;
+  }
+
+  return_if (__atomic_fetch_add(
+    &self->count, 1, __ATOMIC_RELAXED) < burst) true;
+  __atomic_fetch_add(&self->suppressed, 1, __ATOMIC_RELAXED);
+  return false;
+}
+
+
+/******************************************************************************
+ * Deferred log
+ ******************************************************************************/
+
+// records per thread, a power of 2
+#define LOGGER_RING_SIZE 4096
+// how long the log thread sleeps when all rings are empty, in ms
+#define LOGGER_ASYNC_INTERVAL 10
+
+
+struct LoggerRecord {
+  alignas(16) unsigned char data[LOGGER_RECORD_DATA_SIZE];
+  LoggerRecordFormat format;
+  const char *file;
+  const char *func;
+  int line;
+  unsigned char level;
+};
+
+// single producer, the owner thread; single consumer, the log thread
+struct LoggerRing {
+  // only touched by the log thread once published
+  struct LoggerRing *next;
+  // owner thread has exited
+  atomic_bool closed;
+  // records not pushed for the ring being full
+  atomic_ulong dropped;
+  // drops already reported, log thread only
+  unsigned long reported;
+
+  alignas(64) atomic_uint head;
+  // last tail seen, owner thread only
+  unsigned int tail_cache;
+
+  alignas(64) atomic_uint tail;
+
+  struct LoggerRecord records[LOGGER_RING_SIZE];
+};
+
+
+static const struct Logger *logger_async_owner;
+static atomic_bool logger_async_stopping;
+static thrd_t logger_async_thread;
+static _Atomic(struct LoggerRing *) logger_rings;
+static tss_t logger_ring_key;
+static thread_local struct LoggerRing *logger_ring;
+
+
+static void logger_ring_close (void *ring) {
+  atomic_store_explicit(
+    &((struct LoggerRing *) ring)->closed, true, memory_order_release);
+}
+
+
+static struct LoggerRing *logger_ring_new (void) {
+  struct LoggerRing *ring =
+    aligned_alloc(alignof(struct LoggerRing), sizeof(struct LoggerRing));
+  return_if_fail (ring != NULL) NULL;
+  ring->closed = false;
+  ring->dropped = 0;
+  ring->reported = 0;
+  ring->head = 0;
+  ring->tail_cache = 0;
+  ring->tail = 0;
+  ring->next = atomic_load_explicit(&logger_rings, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+    &logger_rings, &ring->next, ring,
+    memory_order_release, memory_order_relaxed)) { }
+  tss_set(logger_ring_key, ring);
+  return ring;
+}
+
+
+static void logger_ring_unlink (struct LoggerRing *ring) {
+  struct LoggerRing *first = ring;
+  if (!atomic_compare_exchange_strong_explicit(
+      &logger_rings, &first, ring->next,
+      memory_order_relaxed, memory_order_relaxed)) {
+    // not the first one, and only the log thread modifies links
+    struct LoggerRing *prev = first;
+    while (prev->next != ring) {
+      prev = prev->next;
+    }
+    prev->next = ring->next;
+  }
+  free(ring);
+}
+
+
+static void logger_record_format (const struct LoggerRecord *record) {
+  struct LoggerEvent event;
+  LoggerEvent_init_func(
+    &event, logger_async_owner, record->level, record->file, record->line,
+    record->func);
+  record->format(&event, record->data);
+  LoggerEvent_destroy_inline(&event);
+}
+
+
+// returns number of records formatted
+static unsigned int logger_ring_drain (struct LoggerRing *ring) {
+  unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  for (unsigned int i = tail; i != head; i++) {
+    logger_record_format(&ring->records[i % LOGGER_RING_SIZE]);
+  }
+  atomic_store_explicit(&ring->tail, head, memory_order_release);
+
+  unsigned long dropped =
+    atomic_load_explicit(&ring->dropped, memory_order_relaxed);
+  if unlikely (dropped != ring->reported) {
+    Logger_log_func(
+      logger_async_owner, LOG_LEVEL_WARNING, NULL, 0, NULL,
+      "Dropped %lu log record(s)", dropped - ring->reported);
+    ring->reported = dropped;
+  }
+  return head - tail;
+}
+
+
+static int logger_async_main (void *arg) {
+  (void) arg;
+
+  while (1) {
+    bool stopping =
+      atomic_load_explicit(&logger_async_stopping, memory_order_acquire);
+
+    unsigned int n = 0;
+    struct LoggerRing *next;
+    for (struct LoggerRing *ring = atomic_load_explicit(
+           &logger_rings, memory_order_acquire); ring != NULL; ring = next) {
+      next = ring->next;
+      n += logger_ring_drain(ring);
+      if unlikely (atomic_load_explicit(&ring->closed, memory_order_acquire)) {
+        // records pushed before closing
+        n += logger_ring_drain(ring);
+        logger_ring_unlink(ring);
+      }
+    }
+
+    if (n == 0) {
+      break_if (stopping);
+      thrd_sleep(&(struct timespec) {
+        .tv_nsec = LOGGER_ASYNC_INTERVAL * 1000000}, NULL);
+    }
+  }
+  return 0;
+}
+
+
+int Logger_defer_func (
+    const struct Logger * __restrict self, int level,
+    const char * __restrict file, int line, const char * __restrict func,
+    LoggerRecordFormat format, const void * __restrict data, size_t size) {
+  return_if (!Logger_would_log(self, level)) -1;
+
+  if unlikely (!self->async || size > LOGGER_RECORD_DATA_SIZE || (
+      level <= LOG_LEVEL_WARNING && level <= self->fatal)) {
+    struct LoggerEvent event;
+    int res = LoggerEvent_init_func(&event, self, level, file, line, func);
+    event.skip = 1;
+    LOGGER_EVENT_GUARD_BEGIN(&event);
+    res += format(&event, data);
+    res += LoggerEvent_destroy_inline(&event);
+    LOGGER_EVENT_GUARD_END(&event);
+    return res;
+  }
+
+  struct LoggerRing *ring = logger_ring;
+  if unlikely (ring == NULL) {
+    ring = logger_ring_new();
+    return_if_fail (ring != NULL) -1;
+    logger_ring = ring;
+  }
+
+  unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if unlikely (head - ring->tail_cache >= LOGGER_RING_SIZE) {
+    ring->tail_cache =
+      atomic_load_explicit(&ring->tail, memory_order_acquire);
+    should (head - ring->tail_cache < LOGGER_RING_SIZE) otherwise {
+      atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+      return -1;
+    }
+  }
+
+  struct LoggerRecord *record = &ring->records[head % LOGGER_RING_SIZE];
+  memcpy(record->data, data, size);
+  record->format = format;
+  record->file = file;
+  record->func = func;
+  record->line = line;
+  record->level = level;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+  return 0;
+}
+
+
+int Logger_async_start (struct Logger *self) {
+  should (logger_async_owner == NULL) otherwise {
+    errno = EBUSY;
+    return -1;
+  }
+
+  static bool key_created = false;
+  if (!key_created) {
+    should (tss_create(
+        &logger_ring_key, logger_ring_close) == thrd_success) otherwise {
+      errno = EAGAIN;
+      return -1;
+    }
+    key_created = true;
+  }
+
+  logger_async_owner = self;
+  atomic_store_explicit(&logger_async_stopping, false, memory_order_relaxed);
+  int ret = thrd_create(&logger_async_thread, logger_async_main, NULL);
+  should (ret == thrd_success) otherwise {
+    logger_async_owner = NULL;
+    errno = EAGAIN;
+    return -1;
+  }
+  self->async = true;
+  return 0;
+}
+
+
+void Logger_async_stop (struct Logger *self) {
+  return_if_fail (self->async && logger_async_owner == self);
+  self->async = false;
+  atomic_store_explicit(&logger_async_stopping, true, memory_order_release);
+  thrd_join(logger_async_thread, NULL);
+  logger_async_owner = NULL;
+}
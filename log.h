@@ -79,6 +79,11 @@ enum LogLevel {
 /// name of log levels
 extern const char * const LogLevel_names[LOG_LEVEL_COUNT];
 
+#ifndef LOG_COMPILE_LEVEL
+/// least severe level to compile, you may define it before include this header
+# define LOG_COMPILE_LEVEL LOG_LEVEL_VERBOSE
+#endif
+
 __attribute__((const, warn_unused_result))
 /**
  * @brief Clamp a log level to a valid value.
@@ -114,7 +119,7 @@ struct LoggerStream {
     access(read_only, 2), access(read_only, 4),
     access(read_only, 6), access(read_only, 7)))
   /**
-   * @brief begin output function
+   * @brief begin output function, which appends to the event buffer
    *
    * @param self Log event.
    * @param domain Log domain.
@@ -129,14 +134,14 @@ struct LoggerStream {
     struct LoggerEvent * __restrict self, const char * __restrict domain,
     unsigned char level, const char * __restrict file, int line,
     const char * __restrict func, const char * __restrict sgr);
-  __attribute__((access(read_only, 1)))
+  __attribute__((access(read_write, 1)))
   /**
-   * @brief end output function
+   * @brief end output function, called after the event is written
    *
    * @param self Log event.
    * @return Number of bytes written.
    */
-  int (*end) (const struct LoggerEvent * __restrict self);
+  int (*end) (struct LoggerEvent * __restrict self);
 };
 
 /// log stream for @c stdout
@@ -184,6 +189,8 @@ struct Logger {
     /// all flags
     unsigned char flags;
   };
+  /// whether deferred records are formatted by the log thread
+  bool async;
 
   /// log domain
   char *domain;
@@ -246,13 +253,16 @@ __attribute__((pure, warn_unused_result, nonnull, access(read_only, 1)))
  * @memberof Logger
  * @brief Test whether a log level will be logged.
  *
+ * Levels less severe than #LOG_COMPILE_LEVEL are never logged, so that
+ * statements at constant levels are compiled out.
+ *
  * @param self Log controller.
  * @param level Log level.
  * @return @c true if will.
  */
 inline bool Logger_would_log (
     const struct Logger * __restrict self, int level) {
-  return level <= self->level;
+  return level <= LOG_COMPILE_LEVEL && level <= self->level;
 }
 /**
  * @relates Logger
@@ -268,6 +278,9 @@ inline bool Logger_would_log (
  * LoggerEvent
  ******************************************************************************/
 
+/// size of the inline buffer of a log event
+#define LOGGER_EVENT_BUFFER_SIZE 512
+
 /// Log event.
 struct LoggerEvent {
   /// output stream
@@ -295,6 +308,11 @@ struct LoggerEvent {
     /// all flags
     unsigned char flags;
   };
+
+  /// length of buffered output
+  unsigned short len;
+  /// buffered output, written with one @c write() when the event ends
+  char buf[LOGGER_EVENT_BUFFER_SIZE];
 };
 
 #ifndef LOGGER_EVENT_VAR_NAME
@@ -329,7 +347,25 @@ struct LoggerEvent {
 #endif
 /// @endcond
 
-__attribute__((nonnull, access(read_only, 1), access(read_only, 2)))
+__attribute__((nonnull(1), access(read_write, 1), access(read_only, 2, 3)))
+/**
+ * @memberof LoggerEvent
+ * @brief Write buffered output of a log event, followed by a message, and
+ *  empty the buffer.
+ *
+ * The message is appended to the buffer if it fits, otherwise both are
+ * written with one @c writev().
+ *
+ * @param self Log event.
+ * @param str Message. Can be @c NULL if @p len is 0.
+ * @param len Length of message.
+ * @return Number of bytes written.
+ */
+int LoggerEvent_flush_func (
+  struct LoggerEvent * __restrict self, const char * __restrict str,
+  size_t len);
+
+__attribute__((nonnull, access(read_write, 1), access(read_only, 2)))
 /**
  * @memberof LoggerEvent
  * @brief Append message in a log event.
@@ -342,8 +378,27 @@ __attribute__((nonnull, access(read_only, 1), access(read_only, 2)))
  * @return Number of bytes written.
  */
 inline int LoggerEvent_log_va_func (
-    const struct LoggerEvent * __restrict self,
+    struct LoggerEvent * __restrict self,
     const char * __restrict format, va_list ap) {
+  size_t avail = sizeof(self->buf) - self->len;
+  va_list aq;
+  va_copy(aq, ap);
+  int res = vsnprintf(self->buf + self->len, avail, format, aq);
+  va_end(aq);
+  if (__builtin_expect(res >= 0 && (size_t) res < avail, 1)) {
+    self->len += res;
+    return res;
+  }
+  if (res < 0) {
+    return res;
+  }
+
+  // spill what is buffered, then format again
+  LoggerEvent_flush_func(self, NULL, 0);
+  if ((size_t) res < sizeof(self->buf)) {
+    self->len = vsnprintf(self->buf, sizeof(self->buf), format, ap);
+    return res;
+  }
   return vdprintf(self->stream->fd, format, ap);
 }
 #ifndef LOGGER_NO_OPTIMIZATION
@@ -374,7 +429,7 @@ inline int LoggerEvent_log_va_func (
 #define LOGEVENT_LOG_VA(format, ap) LoggerEvent_log_va( \
   &LOGGER_EVENT_VAR_NAME, format, ap)
 
-__attribute__((nonnull, access(read_only, 1), access(read_only, 2),
+__attribute__((nonnull, access(read_write, 1), access(read_only, 2),
                format(printf, 2, 3)))
 /**
  * @memberof LoggerEvent
@@ -388,7 +443,7 @@ __attribute__((nonnull, access(read_only, 1), access(read_only, 2),
  * @return Number of bytes written.
  */
 int LoggerEvent_log_func (
-  const struct LoggerEvent * __restrict self,
+  struct LoggerEvent * __restrict self,
   const char * __restrict format, ...);
 #ifndef LOGGER_NO_OPTIMIZATION
 /**
@@ -417,7 +472,7 @@ int LoggerEvent_log_func (
  */
 #define LOGEVENT_LOG(...) LoggerEvent_log(&LOGGER_EVENT_VAR_NAME, __VA_ARGS__)
 
-__attribute__((nonnull, access(read_only, 1), access(read_only, 2, 3)))
+__attribute__((nonnull, access(read_write, 1), access(read_only, 2, 3)))
 /**
  * @memberof LoggerEvent
  * @brief Append message in a log event.
@@ -430,9 +485,14 @@ __attribute__((nonnull, access(read_only, 1), access(read_only, 2, 3)))
  * @return Number of bytes written.
  */
 inline int LoggerEvent_write_func (
-    const struct LoggerEvent * __restrict self,
+    struct LoggerEvent * __restrict self,
     const char * __restrict str, size_t len) {
-  return write(self->stream->fd, str, len);
+  if (__builtin_expect(len > sizeof(self->buf) - self->len, 0)) {
+    return LoggerEvent_flush_func(self, str, len);
+  }
+  memcpy(self->buf + self->len, str, len);
+  self->len += len;
+  return len;
 }
 #ifndef LOGGER_NO_OPTIMIZATION
 /**
@@ -462,7 +522,7 @@ inline int LoggerEvent_write_func (
 #define LOGEVENT_WRITE(str, len) LoggerEvent_write( \
   &LOGGER_EVENT_VAR_NAME, str, len)
 
-__attribute__((nonnull, access(read_only, 1), access(read_only, 2)))
+__attribute__((nonnull, access(read_write, 1), access(read_only, 2)))
 /**
  * @memberof LoggerEvent
  * @brief Append message in a log event.
@@ -474,7 +534,7 @@ __attribute__((nonnull, access(read_only, 1), access(read_only, 2)))
  * @return Number of bytes written.
  */
 inline int LoggerEvent_puts_func (
-    const struct LoggerEvent * __restrict self, const char * __restrict str) {
+    struct LoggerEvent * __restrict self, const char * __restrict str) {
   return LoggerEvent_write_func(self, str, strlen(str));
 }
 #ifndef LOGGER_NO_OPTIMIZATION
@@ -502,7 +562,7 @@ inline int LoggerEvent_puts_func (
  */
 #define LOGEVENT_PUTS(str) LoggerEvent_puts(&LOGGER_EVENT_VAR_NAME, str)
 
-__attribute__((nonnull, access(read_only, 1)))
+__attribute__((nonnull, access(read_write, 1)))
 /**
  * @memberof LoggerEvent
  * @brief Write an error message corresponding to the current value of @c errno
@@ -516,7 +576,7 @@ __attribute__((nonnull, access(read_only, 1)))
  * @return Number of bytes written.
  */
 int LoggerEvent_perror_func (
-  const struct LoggerEvent * __restrict self, int errnum, bool colon);
+  struct LoggerEvent * __restrict self, int errnum, bool colon);
 #ifndef LOGGER_NO_OPTIMIZATION
 /**
  * @relates LoggerEvent
@@ -548,7 +608,7 @@ int LoggerEvent_perror_func (
 #define LOGEVENT_PERROR(errnum, colon) LoggerEvent_perror( \
   &LOGGER_EVENT_VAR_NAME, errnum, colon)
 
-__attribute__((noinline, nonnull, access(read_only, 1)))
+__attribute__((noinline, nonnull, access(read_write, 1)))
 /**
  * @memberof LoggerEvent
  * @brief Print backtrace in a log event, skip topmost @p self->skip + @p skip
@@ -562,7 +622,7 @@ __attribute__((noinline, nonnull, access(read_only, 1)))
  * @return 0.
  */
 int LoggerEvent_backtrace_func (
-  const struct LoggerEvent * __restrict self, int skip);
+  struct LoggerEvent * __restrict self, int skip);
 #ifndef LOGGER_NO_OPTIMIZATION
 /**
  * @relates LoggerEvent
@@ -593,7 +653,7 @@ int LoggerEvent_backtrace_func (
 #define LOGEVENT_BACKTRACE(skip) LoggerEvent_backtrace( \
   &LOGGER_EVENT_VAR_NAME, skip)
 
-__attribute__((noinline, access(read_only, 1)))
+__attribute__((noinline, access(read_write, 1)))
 /**
  * @memberof LoggerEvent
  * @brief End a log event, write a new-line, print backtrace if
@@ -606,8 +666,8 @@ __attribute__((noinline, access(read_only, 1)))
  * @return Number of bytes written. If @p self->fatal, this function should not
  *  return, unless @p self->debug and debugger is attached.
  */
-int LoggerEvent_destroy_func (const struct LoggerEvent * __restrict self);
-__attribute__((always_inline, access(read_only, 1)))
+int LoggerEvent_destroy_func (struct LoggerEvent * __restrict self);
+__attribute__((always_inline, access(read_write, 1)))
 /**
  * @memberof LoggerEvent
  * @brief End a log event, write a new-line, print backtrace if
@@ -620,7 +680,7 @@ __attribute__((always_inline, access(read_only, 1)))
  */
 #define LoggerEvent_destroy_inline(self) __builtin_expect((self)->flags, 0) ? \
   LoggerEvent_destroy_func(self) : \
-  write((self)->stream->fd, "\n", 1) + ( \
+  LoggerEvent_flush_func(self, "\n", 1) + ( \
     __builtin_expect((self)->stream->end != NULL, 0) ? \
       (self)->stream->end(self) : 0)
 #ifndef LOGGER_NO_OPTIMIZATION
@@ -679,6 +739,7 @@ inline int LoggerEvent_init_func (
     logger->formatted[LogLevel_clamp(level)];
 
   self->stream = formatted.stream;
+  self->len = 0;
 
   self->skip = 0;
   self->exit_status = 0;
@@ -880,7 +941,7 @@ int Logger_log_func (
     int res = LoggerEvent_init_func( \
       &__logger_event, self, level, file, line, func); \
     LOGGER_EVENT_GUARD_BEGIN(&__logger_event); \
-    res += dprintf(__logger_event.stream->fd, __VA_ARGS__); \
+    res += LoggerEvent_log_func(&__logger_event, __VA_ARGS__); \
     res += LoggerEvent_destroy_inline(&__logger_event); \
     LOGGER_EVENT_GUARD_END(&__logger_event); \
     res; \
@@ -956,7 +1017,7 @@ int Logger_log_perror_func (
     int res = LoggerEvent_init_func( \
       &__logger_event, self, level, file, line, func); \
     LOGGER_EVENT_GUARD_BEGIN(&__logger_event); \
-    res += dprintf(__logger_event.stream->fd, __VA_ARGS__); \
+    res += LoggerEvent_log_func(&__logger_event, __VA_ARGS__); \
     res += LoggerEvent_perror_func(&__logger_event, errnum, true); \
     LOGGER_EVENT_GUARD_END(&__logger_event); \
     res += LoggerEvent_destroy_inline(&__logger_event); \
@@ -996,6 +1057,240 @@ int Logger_log_perror_func (
   &CURRENT_LOGGER, level, __VA_ARGS__)
 
 
+
+/******************************************************************************
+ * Rate-limited log
+ ******************************************************************************/
+
+#ifndef LOG_LIMIT_BURST
+/// messages logged per interval per call site, you may define it before include
+# define LOG_LIMIT_BURST 10
+#endif
+#ifndef LOG_LIMIT_INTERVAL
+/// interval of rate limit in seconds, you may define it before include
+# define LOG_LIMIT_INTERVAL 5
+#endif
+
+/// Rate limit state of a log call site.
+struct LoggerLimit {
+  /// current interval, in units of the interval since boot
+  long window;
+  /// messages seen in current interval
+  unsigned int count;
+  /// messages suppressed since the last summary
+  unsigned long suppressed;
+};
+
+__attribute__((nonnull, access(read_write, 1), access(write_only, 4)))
+/**
+ * @memberof LoggerLimit
+ * @brief Count a message of a call site and test whether it may be logged.
+ *
+ * Safe to be called concurrently, but counts are approximate when threads
+ * race at the start of an interval.
+ *
+ * @param self Rate limit state.
+ * @param burst Messages logged per interval.
+ * @param interval Interval in seconds.
+ * @param[out] suppressed Messages suppressed before this one, to be reported
+ *  once.
+ * @return @c true if the message may be logged.
+ */
+bool LoggerLimit_allow (
+  struct LoggerLimit * __restrict self, unsigned int burst, int interval,
+  unsigned long * __restrict suppressed);
+/**
+ * @relates Logger
+ * @brief Run a log statement at most #LOG_LIMIT_BURST times per
+ *  #LOG_LIMIT_INTERVAL seconds per call site, and log how many runs were
+ *  suppressed before the next one.
+ *
+ * @param self Log controller.
+ * @param level Log level.
+ * @param stmt Log statement.
+ * @return Result of @p stmt, or -1 if no logging happens.
+ */
+#define Logger_limit(self, level, stmt) __extension__ ({ \
+  static struct LoggerLimit __logger_limit; \
+  unsigned long __logger_limit_suppressed; \
+  int __logger_limit_res = -1; \
+  if (Logger_would_log(self, level) && LoggerLimit_allow( \
+      &__logger_limit, LOG_LIMIT_BURST, LOG_LIMIT_INTERVAL, \
+      &__logger_limit_suppressed)) { \
+    if (__builtin_expect(__logger_limit_suppressed != 0, 0)) { \
+      int __logger_limit_errnum = errno; \
+      Logger_log(self, level, "suppressed %lu similar messages", \
+                 __logger_limit_suppressed); \
+      errno = __logger_limit_errnum; \
+    } \
+    __logger_limit_res = (stmt); \
+  } \
+  __logger_limit_res; \
+})
+/**
+ * @relates Logger
+ * @brief Write a rate-limited log message, see #Logger_limit().
+ *
+ * @param self Log controller.
+ * @param level Log level.
+ * @param format Format string.
+ * @param ... Format arguments.
+ * @return Number of bytes written, or -1 if no logging happens.
+ */
+#define Logger_log_limited(self, level, ...) Logger_limit( \
+  self, level, Logger_log(self, level, __VA_ARGS__))
+/**
+ * @relates Logger
+ * @brief Write a rate-limited log message using #CURRENT_LOGGER, see
+ *  #Logger_limit().
+ *
+ * @param level Log level.
+ * @param format Format string.
+ * @param ... Format arguments.
+ * @return Number of bytes written, or -1 if no logging happens.
+ */
+#define LOG_LIMITED(level, ...) Logger_log_limited( \
+  &CURRENT_LOGGER, level, __VA_ARGS__)
+/**
+ * @relates Logger
+ * @brief Write a rate-limited log message, followed by an error message
+ *  corresponding to the current value of @c errno, see #Logger_limit().
+ *
+ * @param self Log controller.
+ * @param level Log level.
+ * @param format Format string.
+ * @param ... Format arguments.
+ * @return Number of bytes written, or -1 if no logging happens.
+ */
+#define Logger_log_perror_limited(self, level, ...) Logger_limit( \
+  self, level, Logger_log_perror(self, level, __VA_ARGS__))
+/**
+ * @relates Logger
+ * @brief Write a rate-limited log message using #CURRENT_LOGGER, followed by
+ *  an error message corresponding to the current value of @c errno, see
+ *  #Logger_limit().
+ *
+ * @param level Log level.
+ * @param format Format string.
+ * @param ... Format arguments.
+ * @return Number of bytes written, or -1 if no logging happens.
+ */
+#define LOG_PERROR_LIMITED(level, ...) Logger_log_perror_limited( \
+  &CURRENT_LOGGER, level, __VA_ARGS__)
+
+
+/******************************************************************************
+ * Deferred log
+ ******************************************************************************/
+
+/// maximum size of raw arguments of a deferred log record
+#define LOGGER_RECORD_DATA_SIZE 48
+
+/**
+ * @memberof Logger
+ * @brief Format the message of a deferred log record.
+ *
+ * @param event Log event.
+ * @param data Raw arguments of the record.
+ * @return Number of bytes written.
+ */
+typedef int (*LoggerRecordFormat) (
+  struct LoggerEvent * __restrict event, const void * __restrict data);
+
+__attribute__((nonnull(1, 6, 7), access(read_only, 1), access(read_only, 3),
+               access(read_only, 5), access(read_only, 7, 8)))
+/**
+ * @memberof Logger
+ * @brief Write a log message whose formatting is deferred to the log thread.
+ *
+ * You should use #Logger_defer() instead.
+ *
+ * If @p self is not in async mode, or @p level is fatal, the message is
+ * formatted at once. Otherwise the record is pushed into the ring of the
+ * calling thread, and dropped if the ring is full.
+ *
+ * @param self Log controller.
+ * @param level Log level.
+ * @param file File name at which logger is called. Can be @c NULL.
+ * @param line Line number at which logger is called.
+ * @param func Function name at which logger is called. Can be @c NULL.
+ * @param format Function to format the message.
+ * @param data Raw arguments, copied into the record.
+ * @param size Size of @p data, at most #LOGGER_RECORD_DATA_SIZE.
+ * @return Number of bytes written, 0 if deferred, or -1 if no logging
+ *  happens.
+ */
+int Logger_defer_func (
+  const struct Logger * __restrict self, int level,
+  const char * __restrict file, int line, const char * __restrict func,
+  LoggerRecordFormat format, const void * __restrict data, size_t size);
+/**
+ * @relates Logger
+ * @brief Write a log message whose formatting is deferred to the log thread.
+ *
+ * @param self Log controller.
+ * @param level Log level.
+ * @param format Function to format the message.
+ * @param data Pointer to raw arguments, copied into the record.
+ * @return Number of bytes written, 0 if deferred, or -1 if no logging
+ *  happens.
+ */
+#define Logger_defer(self, level, format, data) ( \
+  !Logger_would_log(self, level) ? -1 : Logger_defer_func( \
+    self, level, LOGGER_EVENT_FILE_NAME, __LINE__, LOGGER_EVENT_FUNC_NAME, \
+    format, data, sizeof(*(data))))
+/**
+ * @relates Logger
+ * @brief Write a log message using #CURRENT_LOGGER whose formatting is
+ *  deferred to the log thread.
+ *
+ * @param level Log level.
+ * @param format Function to format the message.
+ * @param data Pointer to raw arguments, copied into the record.
+ * @return Number of bytes written, 0 if deferred, or -1 if no logging
+ *  happens.
+ */
+#define LOG_DEFER(level, format, data) Logger_defer( \
+  &CURRENT_LOGGER, level, format, data)
+
+__attribute__((nonnull))
+/**
+ * @memberof Logger
+ * @brief Start the log thread and put a log controller in async mode.
+ *
+ * Only one log controller can be in async mode at a time.
+ *
+ * @param self Log controller.
+ * @return 0 on success, -1 on error with @c errno set.
+ */
+int Logger_async_start (struct Logger *self);
+__attribute__((nonnull))
+/**
+ * @memberof Logger
+ * @brief Format all pending records, stop the log thread and leave async
+ *  mode.
+ *
+ * Threads that defer records must have stopped.
+ *
+ * @param self Log controller.
+ */
+void Logger_async_stop (struct Logger *self);
+/**
+ * @relates Logger
+ * @brief Put #CURRENT_LOGGER in async mode.
+ *
+ * @return 0 on success, -1 on error with @c errno set.
+ */
+#define LOGGER_ASYNC_START() Logger_async_start( \
+  (struct Logger *) &CURRENT_LOGGER)
+/**
+ * @relates Logger
+ * @brief Take #CURRENT_LOGGER out of async mode.
+ */
+#define LOGGER_ASYNC_STOP() Logger_async_stop( \
+  (struct Logger *) &CURRENT_LOGGER)
+
+
 #ifdef __cplusplus
 }
 #endif
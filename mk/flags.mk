@@ -17,6 +17,12 @@ LDFLAGS ?= -flto
 # debug
 ifeq ($(DEBUG), 1)
 	CANYFLAGS += -g
+else
+	# log statements less severe than this level are compiled out
+	LOG_COMPILE_LEVEL ?= 6
+endif
+ifneq ($(strip $(LOG_COMPILE_LEVEL)),)
+	CPPFLAGS += -DLOG_COMPILE_LEVEL=$(LOG_COMPILE_LEVEL)
 endif
 ifeq ($(RELEASE), 0)
 	CANYFLAGS += -DDEBUG
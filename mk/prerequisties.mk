@@ -1,5 +1,5 @@
 ifeq ($(DEBUG), 1)
-PREREQUISITES := $(SOURCES:.c=.d)
+PREREQUISITES := $(patsubst %.c,%.d,$(sort $(SOURCES) $(EXTRA_SOURCES)))
 THIS_MAKEFILE_LIST := $(MAKEFILE_LIST)
 
 %.d: %.c
@@ -0,0 +1,62 @@
+#ifndef PROBE_H
+#define PROBE_H
+
+/** @file
+ * USDT probes of provider @c rdnstun, for bpftrace and other tracers.
+ *
+ * Arguments are only evaluated while a tracer is attached to the probe.
+ * Without <sys/sdt.h>, or with @c NO_USDT, probes compile to nothing.
+ *
+ *   packet_read(fd, len)
+ *   chain_selected(family, network, prefix, dup, pos)
+ *   reply_type(family, host addr, pos, ICMP type, ICMP code)
+ *   packet_drop(reason, reason name, packet)
+ *   reply_written(fd, len, latency in ns)
+ *
+ * where family is 4 or 6, pos the index of the replying host in its chain,
+ * dup the copy of a chain duplicated by -E, and reason a ::StatsCounter.
+ */
+
+#ifndef NO_USDT
+# if defined __has_include
+#  if __has_include(<sys/sdt.h>)
+#   define PROBE_USDT
+#  endif
+# endif
+#endif
+
+#ifdef PROBE_USDT
+# define _SDT_HAS_SEMAPHORES 1
+# include <sys/sdt.h>
+
+// raised by tracers attached to the probe
+# define PROBE_SEMAPHORE(name) rdnstun_ ## name ## _semaphore
+
+extern volatile unsigned short PROBE_SEMAPHORE(packet_read);
+extern volatile unsigned short PROBE_SEMAPHORE(chain_selected);
+extern volatile unsigned short PROBE_SEMAPHORE(reply_type);
+extern volatile unsigned short PROBE_SEMAPHORE(packet_drop);
+extern volatile unsigned short PROBE_SEMAPHORE(reply_written);
+
+# define PROBE_ENABLED(name) __builtin_expect(PROBE_SEMAPHORE(name) != 0, 0)
+# define PROBE(name, ...) do { \
+  if (PROBE_ENABLED(name)) { \
+    STAP_PROBEV(rdnstun, name, __VA_ARGS__); \
+  } \
+} while (0)
+#else
+# define PROBE_ENABLED(name) 0
+static inline void probe_unused (int dummy, ...) {
+  (void) dummy;
+}
+
+// arguments are still referenced, but never evaluated
+# define PROBE(name, ...) do { \
+  if (0) { \
+    probe_unused(0, __VA_ARGS__); \
+  } \
+} while (0)
+#endif
+
+
+#endif /* PROBE_H */
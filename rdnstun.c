@@ -1,4 +1,8 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
 #include <limits.h>
+#include <stdatomic.h>
 #include <poll.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -13,123 +17,1002 @@
 #include <netinet/ip_icmp.h>
 #include <netinet/ip6.h>
 #include <linux/if_tun.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "macro.h"
 #include "utils.h"
 #include "log.h"
 #include "iface.h"
+#include "arena.h"
 #include "chain.h"
+#include "table.h"
+#include "image.h"
+#include "cache.h"
+#include "epoch.h"
+#include "latency.h"
+#include "stats.h"
 #include "threadname.h"
+#include "uring.h"
+#include "probe.h"
 #include "rdnstun.h"
 
 
-volatile bool rdnstun_shutdown = false;
+int rdnstun_shutdownfd = -1;
+int rdnstun_reloadfd = -1;
+static const struct StatsSegment *rdnstun_stats;
+static atomic_bool rdnstun_report_requested;
+
+#ifdef PROBE_USDT
+// referenced by the notes of the probes, where tracers find them
+# define PROBE_SEMAPHORE_DEFINE(name) \
+  __attribute__((section(".probes"))) \
+  volatile unsigned short PROBE_SEMAPHORE(name)
+PROBE_SEMAPHORE_DEFINE(packet_read);
+PROBE_SEMAPHORE_DEFINE(chain_selected);
+PROBE_SEMAPHORE_DEFINE(reply_type);
+PROBE_SEMAPHORE_DEFINE(packet_drop);
+PROBE_SEMAPHORE_DEFINE(reply_written);
+#endif
 
 
 static void shutdown_rdnstun (int sig) {
   (void) sig;
   LOG(LOG_LEVEL_INFO, "Shutting down " RDNSTUN_NAME);
-  rdnstun_shutdown = true;
+  // wake up all workers, eventfd stays readable since no one consumes it
+  eventfd_write(rdnstun_shutdownfd, 1);
 }
 
 
-static int rdnstun (
-    int tunfd, const struct HostChain *v4_chains,
-    const struct HostChain *v6_chains, volatile bool *shutdown) {
-  threadname_format("fd %d", tunfd);
+static void reload_rdnstun (int sig) {
+  (void) sig;
+  eventfd_write(rdnstun_reloadfd, 1);
+}
 
-  struct pollfd pollfd = {.fd = tunfd, .events = POLLIN};
 
-  while (1) {
-    int pollres = poll(&pollfd, 1, RDNSTUN_SLEEP_TIME * 1000);
-    break_if_fail (!*shutdown);
+// chains of the command line only, a hangup should not kill the daemon
+static void ignore_reload (int sig) {
+  (void) sig;
+  LOG(LOG_LEVEL_NOTICE, "Nothing to reload without -c or --table");
+}
+
+
+static void request_report (int sig) {
+  (void) sig;
+  // picked up by the next worker to wake up
+  atomic_store_explicit(
+    &rdnstun_report_requested, true, memory_order_relaxed);
+}
+
+
+// SIGINT and SIGUSR1 are left to the workers, so that SIGUSR1 interrupts
+// their wait; other threads never take them
+static void rdnstun_sigmask (int how) {
+  sigset_t sigset;
+  sigemptyset(&sigset);
+  sigaddset(&sigset, SIGINT);
+  sigaddset(&sigset, SIGUSR1);
+  pthread_sigmask(how, &sigset, NULL);
+}
+
+
+static void rdnstun_report (void) {
+  return_if_not (atomic_load_explicit(
+    &rdnstun_report_requested, memory_order_relaxed));
+  return_if_not (atomic_exchange(&rdnstun_report_requested, false));
+
+  struct LatencyHist merged = {0};
+  for (unsigned int i = 0; i < rdnstun_stats->header->nthread; i++) {
+    LatencyHist_merge(&merged, &rdnstun_stats->threads[i].latency);
+  }
+  static const double percentiles[] = {50, 90, 99, 99.9, 99.99, 100};
+  double ns[arraysize(percentiles)];
+  for (unsigned int i = 0; i < arraysize(percentiles); i++) {
+    ns[i] = LatencyHist_percentile(&merged, percentiles[i]) *
+            rdnstun_stats->header->ns_per_tick;
+  }
+  LOG(LOG_LEVEL_NOTICE,
+      "Reply latency of %llu packets: p50 %.0f ns, p90 %.0f ns, "
+      "p99 %.0f ns, p99.9 %.0f ns, p99.99 %.0f ns, max %.0f ns",
+      (unsigned long long) LatencyHist_total(&merged),
+      ns[0], ns[1], ns[2], ns[3], ns[4], ns[5]);
+}
+
+
+struct RDnsTunTables {
+  // chains is NULL if no chain of that version
+  struct HostChainTable v4;
+  struct HostChainTable v6;
+  // hosts of chains from the config file
+  struct Arena arena;
+  // compiled table the chains are served from, base is NULL if none
+  struct TableImage image;
+};
+
+// swapped on reload, the old one is freed once no worker is inside
+static _Atomic(struct RDnsTunTables *) rdnstun_tables;
+static struct Epoch rdnstun_epoch;
 
-    should (pollres >= 0) otherwise {
-      LOG_PERROR(LOG_LEVEL_WARNING, "poll()");
-      continue;
-    }
-    continue_if_not (pollres > 0);
 
-    if (LOG_WOULD_LOG(LOG_LEVEL_DEBUG)) {
-      puts("");
+static enum StatsCounter rdnstun_reply_counter (const unsigned char *packet) {
+  if (((const struct ip *) packet)->ip_v == 4) {
+    const struct icmphdr *icmp =
+      (const struct icmphdr *) (packet + sizeof(struct ip));
+    switch (icmp->type) {
+      case ICMP_ECHOREPLY:
+        return STATS_REPLY_ECHO;
+      case ICMP_TIMXCEED:
+        return STATS_REPLY_TIME_EXCEEDED;
+      default:
+        return icmp->code == ICMP_UNREACH_PORT ?
+          STATS_REPLY_UNREACH_PORT : STATS_REPLY_UNREACH_HOST;
     }
-    // data from tun/tap: read it
-    unsigned char packet[IP_MAXPACKET];
-    int pkt_receive_len = read(tunfd, packet, sizeof(packet));
-    should (pkt_receive_len >= 0) otherwise {
-      LOG_PERROR(LOG_LEVEL_WARNING, "read() failed");
+  } else {
+    const struct icmp6_hdr *icmp =
+      (const struct icmp6_hdr *) (packet + sizeof(struct ip6_hdr));
+    switch (icmp->icmp6_type) {
+      case ICMP6_ECHO_REPLY:
+        return STATS_REPLY_ECHO;
+      case ICMP6_TIME_EXCEEDED:
+        return STATS_REPLY_TIME_EXCEEDED;
+      default:
+        return icmp->icmp6_code == ICMP6_DST_UNREACH_NOPORT ?
+          STATS_REPLY_UNREACH_PORT : STATS_REPLY_UNREACH_HOST;
     }
-    continue_if_fail (pkt_receive_len > 0);
-    LOG(LOG_LEVEL_DEBUG, "Read %d bytes from fd %d", pkt_receive_len, tunfd);
+  }
+}
 
-    unsigned short pkt_send_len = pkt_receive_len;
-    unsigned char ipver = ((struct ip *) packet)->ip_v;
-    switch (ipver) {
-      int ret;
-      case 4:
-        goto_if_fail (v4_chains != NULL) undefined_ipver;
-        goto_nonzero (HostChain4Array_reply(
-          v4_chains, packet, &pkt_send_len)) fail_reply;
-        break;
-      case 6:
-        goto_if_fail (v6_chains != NULL) undefined_ipver;
-        goto_nonzero (HostChain6Array_reply(
-          v6_chains, packet, &pkt_send_len)) fail_reply;
-        break;
-      default:
-        LOG(LOG_LEVEL_DEBUG, "Unknown IP version %d", ipver);
-        if (0) {
+
+static inline void rdnstun_drop (
+    uint64_t *stats, enum StatsCounter reason, const unsigned char *packet) {
+  stats[reason]++;
+  PROBE(packet_drop, reason, StatsCounter_names[reason], packet);
+}
+
+
+static unsigned short rdnstun_reply (
+    unsigned char *packet, unsigned short len,
+    const struct RDnsTunTables *tables, struct HostChainCache *cache,
+    uint64_t *stats) {
+  unsigned char ipver = ((struct ip *) packet)->ip_v;
+  enum StatsCounter drop;
+  switch (ipver) {
+    int ret;
+    case 4:
+      goto_if_fail (tables->v4.chains != NULL) undefined_ipver;
+      goto_nonzero (
+        HostChainTable4_reply(&tables->v4, cache, packet, &len)) fail_reply;
+      break;
+    case 6:
+      goto_if_fail (tables->v6.chains != NULL) undefined_ipver;
+      goto_nonzero (
+        HostChainTable6_reply(&tables->v6, cache, packet, &len)) fail_reply;
+      break;
+    default:
+      LOG(LOG_LEVEL_DEBUG, "Unknown IP version %d", ipver);
+      drop = STATS_DROP_IPVER;
+      if (0) {
 undefined_ipver:
-          LOG(LOG_LEVEL_DEBUG,
-              "Received IPv%d packet but no IPv%d chains defined",
-              ipver, ipver);
-        }
-        if (0) {
+        LOG(LOG_LEVEL_DEBUG,
+            "Received IPv%d packet but no IPv%d chains defined",
+            ipver, ipver);
+        drop = STATS_DROP_IPVER;
+      }
+      if (0) {
 fail_reply:
-          switch (ret) {
-            case 17:
-              LOG(LOG_LEVEL_DEBUG, "No host to reply");
-              break;
-            case 18:
-              LOG(LOG_LEVEL_WARNING, "Received packet with TTL 0");
-              break;
-            case 19:
-              LOG(LOG_LEVEL_WARNING, "Host TTL too small, this is a bug");
-              break;
-            default:
-              LOG(LOG_LEVEL_WARNING, "Unknown error number %d", ret);
-          }
+        switch (ret) {
+          case 17:
+            LOG(LOG_LEVEL_DEBUG, "No host to reply");
+            drop = STATS_DROP_NO_HOST;
+            break;
+          case 18:
+            LOG_LIMITED(LOG_LEVEL_WARNING, "Received packet with TTL 0");
+            drop = STATS_DROP_TTL_ZERO;
+            break;
+          case 19:
+            LOG_LIMITED(LOG_LEVEL_WARNING, "Host TTL too small, this is a bug");
+            drop = STATS_DROP_HOST_TTL;
+            break;
+          case 20:
+            LOG(LOG_LEVEL_DEBUG, "No chain holds the destination");
+            drop = STATS_DROP_FILTERED;
+            break;
+          default:
+            LOG_LIMITED(LOG_LEVEL_WARNING, "Unknown error number %d", ret);
+            drop = STATS_DROP_OTHER;
         }
-        continue;
+      }
+      rdnstun_drop(stats, drop, packet);
+      return 0;
+  }
+  if (len == 0) {
+    rdnstun_drop(stats, STATS_DROP_IGNORED, packet);
+  } else {
+    stats[rdnstun_reply_counter(packet)]++;
+  }
+  return len;
+}
+
+
+// raw arguments of the debug message of a tun read or write
+struct RDnsTunIOLogRecord {
+  int fd;
+  int len;
+  bool write;
+};
+
+
+static int rdnstun_io_log_format (
+    struct LoggerEvent * __restrict event, const void * __restrict data) {
+  const struct RDnsTunIOLogRecord *record = data;
+  return LoggerEvent_log(
+    event, record->write ?
+      "Write %d bytes to fd %d" : "Read %d bytes from fd %d",
+    record->len, record->fd);
+}
+
+
+static inline void rdnstun_log_io (int fd, int len, bool write) {
+  return_if_not (LOG_WOULD_LOG(LOG_LEVEL_DEBUG));
+  if (!write && !app_logger.async) {
+    // separate packets, only in order when logged synchronously
+    puts("");
+  }
+  struct RDnsTunIOLogRecord record = {.fd = fd, .len = len, .write = write};
+  LOG_DEFER(LOG_LEVEL_DEBUG, rdnstun_io_log_format, &record);
+}
+
+
+static void rdnstun_publish (
+    struct StatsThread *shared, uint64_t *stats,
+    const struct HostChainCache *cache) {
+  stats[STATS_CACHE_HIT] = cache->hit;
+  stats[STATS_CACHE_MISS] = cache->miss;
+  StatsThread_publish(shared, stats);
+}
+
+
+static int rdnstun (
+    int tunfd, int shutdownfd, struct EpochReader *reader,
+    struct StatsThread *shared_stats) {
+  threadname_format("fd %d", tunfd);
+
+  // drain the queue after each wakeup, so switch to non-blocking mode
+  int flags = fcntl(tunfd, F_GETFL);
+  should (flags >= 0 &&
+          fcntl(tunfd, F_SETFL, flags | O_NONBLOCK) >= 0) otherwise {
+    LOG_PERROR(LOG_LEVEL_ERROR, "fcntl(O_NONBLOCK)");
+    return 1;
+  }
+
+  struct HostChainCache cache;
+  HostChainCache_init(&cache);
+  // published once per wakeup and every RDNSTUN_DRAIN_INTERVAL packets,
+  // never touched by readers
+  uint64_t stats[STATS_MAX] = {0};
+  shared_stats->tunfd = tunfd;
+
+  struct pollfd pollfds[2] = {
+    {.fd = tunfd, .events = POLLIN},
+    {.fd = shutdownfd, .events = POLLIN},
+  };
+
+  while (1) {
+    int pollres = poll(pollfds, arraysize(pollfds), -1);
+    should (pollres >= 0) otherwise {
+      if (errno != EINTR) {
+        LOG_PERROR_LIMITED(LOG_LEVEL_WARNING, "poll()");
+        stats[STATS_POLL_ERROR]++;
+      }
+      rdnstun_report();
+      continue;
     }
-    // write it into the tun/tap interface
-    if likely (pkt_send_len > 0) {
+    break_if_fail (pollfds[1].revents == 0);
+    continue_if_not (pollfds[0].revents != 0);
+
+    EpochReader_enter(reader, &rdnstun_epoch);
+    const struct RDnsTunTables *tables = atomic_load(&rdnstun_tables);
+    // end of the last reply, 0 if the last packet got none
+    uint64_t written = 0;
+    for (unsigned int n = 1;; n++) {
+      if unlikely (n % RDNSTUN_DRAIN_INTERVAL == 0) {
+        // the queue may never drain under sustained load, so do not wait
+        // for EAGAIN to see a shutdown
+        break_if (poll(pollfds + 1, 1, 0) > 0);
+        // nor to publish counters and serve a report
+        rdnstun_publish(shared_stats, stats, &cache);
+        rdnstun_report();
+        // do not hold up a reload under sustained load
+        EpochReader_enter(reader, &rdnstun_epoch);
+        tables = atomic_load(&rdnstun_tables);
+        // none of this delays the next packet's reply
+        written = 0;
+      }
+
+      // data from tun/tap: read it
+      unsigned char packet[IP_MAXPACKET];
+      int pkt_receive_len = read(tunfd, packet, sizeof(packet));
+      should (pkt_receive_len >= 0) otherwise {
+        break_if (errno == EAGAIN || errno == EWOULDBLOCK);
+        continue_if (errno == EINTR);
+        LOG_PERROR_LIMITED(LOG_LEVEL_WARNING, "read() failed");
+        stats[STATS_READ_ERROR]++;
+        break;
+      }
+      continue_if_fail (pkt_receive_len > 0);
+      // under load, reads follow replies back to back, so the end of the
+      // last reply stands in for the read time, one syscall early at most
+      uint64_t received = written != 0 ? written : latency_now();
+      written = 0;
+      stats[STATS_READ]++;
+      PROBE(packet_read, tunfd, pkt_receive_len);
+      rdnstun_log_io(tunfd, pkt_receive_len, false);
+
+      unsigned short pkt_send_len = rdnstun_reply(
+        packet, pkt_receive_len, tables, &cache, stats);
+      // write it into the tun/tap interface
+      continue_if_not (pkt_send_len > 0);
       int n_write = write(tunfd, packet, pkt_send_len);
       if unlikely (n_write < 0) {
-        LOG_PERROR(LOG_LEVEL_WARNING, "write() failed");
+        LOG_PERROR_LIMITED(LOG_LEVEL_WARNING, "write() failed");
+        rdnstun_drop(stats, STATS_WRITE_ERROR, packet);
       } else {
-        LOG(LOG_LEVEL_DEBUG, "Write %d bytes to fd %d", n_write, tunfd);
+        written = latency_now();
+        uint64_t latency = written - received;
+        LatencyHist_add(&shared_stats->latency, latency);
+        PROBE(reply_written, tunfd, n_write,
+              (uint64_t) (latency * latency_ns_per_tick));
+        rdnstun_log_io(tunfd, n_write, true);
+        if unlikely (n_write < pkt_send_len) {
+          stats[STATS_SHORT_WRITE]++;
+        }
       }
     }
+    EpochReader_leave(reader);
+    rdnstun_publish(shared_stats, stats, &cache);
+    rdnstun_report();
   }
 
+  LOG(LOG_LEVEL_DEBUG, "Lookup cache of fd %d: %lu hits, %lu misses",
+      tunfd, cache.hit, cache.miss);
   return 0;
 }
 
 
+enum RDnsTunURingOp {
+  RDNSTUN_URING_READ = 1,
+  RDNSTUN_URING_WRITE,
+  RDNSTUN_URING_SHUTDOWN,
+};
+
+#define RDNSTUN_URING_DATA(op, bid) ((unsigned long long) (op) << 32 | (bid))
+// length of a write, next to the buffer id
+#define RDNSTUN_URING_LEN_SHIFT 16
+
+
+static bool rdnstun_uring_read (struct URing *ring, int tunfd, bool multishot) {
+  struct io_uring_sqe *sqe = URing_get_sqe(ring);
+  return_if_fail (sqe != NULL) false;
+  sqe->opcode = multishot ? URING_OP_READ_MULTISHOT : IORING_OP_READ;
+  sqe->fd = tunfd;
+  sqe->off = -1;
+  sqe->len = multishot ? 0 : RDNSTUN_URING_BUFSIZE;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = 0;
+  sqe->user_data = RDNSTUN_URING_DATA(RDNSTUN_URING_READ, 0);
+  return true;
+}
+
+
+static int rdnstun_uring (
+    int tunfd, int shutdownfd, struct EpochReader *reader,
+    struct StatsThread *shared_stats) {
+  threadname_format("fd %d", tunfd);
+
+  struct URing ring;
+  should (URing_init(
+      &ring, RDNSTUN_URING_NBUF * 2,
+      IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN
+  ) == 0) otherwise {
+    LOG_PERROR(LOG_LEVEL_NOTICE, "io_uring_setup()");
+    return -1;
+  }
+  struct URingBufRing bufring;
+  should (URingBufRing_init(
+      &bufring, &ring, 0, RDNSTUN_URING_NBUF, RDNSTUN_URING_BUFSIZE
+  ) == 0) otherwise {
+    LOG_PERROR(LOG_LEVEL_NOTICE, "io_uring_register(PBUF_RING)");
+    URing_destroy(&ring);
+    return -1;
+  }
+
+  struct HostChainCache cache;
+  HostChainCache_init(&cache);
+  uint64_t stats[STATS_MAX] = {0};
+  shared_stats->tunfd = tunfd;
+  // when the read into each buffer was reaped
+  uint64_t received[RDNSTUN_URING_NBUF];
+
+  struct io_uring_sqe *sqe = URing_get_sqe(&ring);
+  sqe->opcode = IORING_OP_POLL_ADD;
+  sqe->fd = shutdownfd;
+  sqe->poll32_events = POLLIN;
+  sqe->user_data = RDNSTUN_URING_DATA(RDNSTUN_URING_SHUTDOWN, 0);
+  bool multishot = true;
+  bool read_armed = rdnstun_uring_read(&ring, tunfd, multishot);
+
+  int ret = 0;
+  while (1) {
+    // submit all replies of the last batch and wait for the next one
+    should (URing_submit_and_wait(&ring, 1) >= 0) otherwise {
+      if (errno != EINTR) {
+        LOG_PERROR_LIMITED(LOG_LEVEL_WARNING, "io_uring_enter()");
+        stats[STATS_POLL_ERROR]++;
+      }
+      rdnstun_report();
+      continue;
+    }
+
+    // one timestamp for the whole batch
+    uint64_t now = latency_now();
+    EpochReader_enter(reader, &rdnstun_epoch);
+    const struct RDnsTunTables *tables = atomic_load(&rdnstun_tables);
+    bool shutdown = false;
+    unsigned int head = *ring.cq_head;
+    for (struct io_uring_cqe *cqe;
+         (cqe = URing_peek_cqe(&ring, &head)) != NULL;) {
+      switch (cqe->user_data >> 32) {
+        case RDNSTUN_URING_READ: {
+          if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            read_armed = false;
+          }
+          should (cqe->res >= 0) otherwise {
+            if (cqe->res == -EINVAL && multishot) {
+              LOG(LOG_LEVEL_INFO, "Multishot read not supported, "
+                                  "fall back to single-shot read");
+              multishot = false;
+            } else if (cqe->res != -ENOBUFS && cqe->res != -EINTR &&
+                       cqe->res != -EAGAIN) {
+              errno = -cqe->res;
+              LOG_PERROR_LIMITED(LOG_LEVEL_WARNING, "read() failed");
+              stats[STATS_READ_ERROR]++;
+              if (cqe->res == -EINVAL) {
+                ret = 1;
+                shutdown = true;
+              }
+            }
+            break;
+          }
+          break_if_fail (cqe->flags & IORING_CQE_F_BUFFER);
+          unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+          unsigned char *packet = URingBufRing_buf(&bufring, bid);
+          if (cqe->res > 0) {
+            received[bid] = now;
+            stats[STATS_READ]++;
+            PROBE(packet_read, tunfd, cqe->res);
+            rdnstun_log_io(tunfd, cqe->res, false);
+
+            unsigned short pkt_send_len = rdnstun_reply(
+              packet, cqe->res, tables, &cache, stats);
+            if likely (pkt_send_len > 0) {
+              // reply in place, buffer is returned once write completes
+              sqe = URing_get_sqe(&ring);
+              if likely (sqe != NULL) {
+                sqe->opcode = IORING_OP_WRITE;
+                sqe->fd = tunfd;
+                sqe->off = -1;
+                sqe->addr = (unsigned long) packet;
+                sqe->len = pkt_send_len;
+                sqe->user_data =
+                  RDNSTUN_URING_DATA(RDNSTUN_URING_WRITE, bid) |
+                  (unsigned long long) pkt_send_len <<
+                    RDNSTUN_URING_LEN_SHIFT;
+                break;
+              }
+              LOG_LIMITED(
+                LOG_LEVEL_WARNING, "Submission queue full, drop reply");
+            }
+          }
+          URingBufRing_add(&bufring, bid);
+          break;
+        }
+        case RDNSTUN_URING_WRITE:
+          if unlikely (cqe->res < 0) {
+            errno = -cqe->res;
+            LOG_PERROR_LIMITED(LOG_LEVEL_WARNING, "write() failed");
+            rdnstun_drop(
+              stats, STATS_WRITE_ERROR,
+              URingBufRing_buf(&bufring, cqe->user_data & 0xffff));
+          } else {
+            uint64_t latency = now - received[cqe->user_data & 0xffff];
+            LatencyHist_add(&shared_stats->latency, latency);
+            PROBE(reply_written, tunfd, cqe->res,
+                  (uint64_t) (latency * latency_ns_per_tick));
+            rdnstun_log_io(tunfd, cqe->res, true);
+            if unlikely ((unsigned int) cqe->res < (
+                (cqe->user_data >> RDNSTUN_URING_LEN_SHIFT) & 0xffff)) {
+              stats[STATS_SHORT_WRITE]++;
+            }
+          }
+          URingBufRing_add(&bufring, cqe->user_data & 0xffff);
+          break;
+        case RDNSTUN_URING_SHUTDOWN:
+          shutdown = true;
+          break;
+      }
+    }
+    EpochReader_leave(reader);
+    URing_cq_seen(&ring, head);
+    URingBufRing_commit(&bufring);
+    rdnstun_publish(shared_stats, stats, &cache);
+    rdnstun_report();
+
+    break_if_fail (!shutdown);
+    if (!read_armed) {
+      read_armed = rdnstun_uring_read(&ring, tunfd, multishot);
+    }
+  }
+
+  LOG(LOG_LEVEL_DEBUG, "Lookup cache of fd %d: %lu hits, %lu misses",
+      tunfd, cache.hit, cache.miss);
+  URingBufRing_destroy(&bufring, &ring);
+  URing_destroy(&ring);
+  return ret;
+}
+
+
 struct RDnsTunArg {
   int tunfd;
-  const struct HostChain *v4_chains;
-  const struct HostChain *v6_chains;
-  volatile bool *shutdown;
+  int shutdownfd;
+  struct EpochReader *reader;
+  bool uring;
+  struct StatsThread *stats;
 };
 
 
 static int start_rdnstun (void *arg) {
   struct RDnsTunArg *rdnstun_arg = arg;
-  return rdnstun(rdnstun_arg->tunfd, rdnstun_arg->v4_chains,
-                 rdnstun_arg->v6_chains, rdnstun_arg->shutdown);
+  rdnstun_sigmask(SIG_UNBLOCK);
+  if (rdnstun_arg->uring) {
+    int ret = rdnstun_uring(
+      rdnstun_arg->tunfd, rdnstun_arg->shutdownfd, rdnstun_arg->reader,
+      rdnstun_arg->stats);
+    return_if (ret >= 0) ret;
+    LOG(LOG_LEVEL_NOTICE, "io_uring not available, fall back to poll()");
+  }
+  return rdnstun(rdnstun_arg->tunfd, rdnstun_arg->shutdownfd,
+                 rdnstun_arg->reader, rdnstun_arg->stats);
+}
+
+
+// chains in the order given, before they are indexed
+struct RDnsTunChains {
+  struct HostChain *v4;
+  struct HostChain *v6;
+  unsigned int v4_len;
+  unsigned int v6_len;
+  unsigned int v4_cap;
+  unsigned int v6_cap;
+  bool last_v6;
+  struct Arena arena;
+};
+
+// a chain option from the command line, kept to rebuild on reload
+struct RDnsTunChainArg {
+  int option;
+  char *arg;
+};
+
+
+static void rdnstun_chains_destroy (struct RDnsTunChains *self) {
+  if (self->v4 != NULL) {
+    HostChainArray_destroy_size(self->v4, self->v4_len);
+    free(self->v4);
+  }
+  if (self->v6 != NULL) {
+    HostChainArray_destroy_size(self->v6, self->v6_len);
+    free(self->v6);
+  }
+  Arena_destroy(&self->arena);
+}
+
+
+// room for n more chains and the terminator
+static int rdnstun_chains_reserve (
+    struct RDnsTunChains *self, bool v6, unsigned int n) {
+  unsigned int len = v6 ? self->v6_len : self->v4_len;
+  unsigned int *cap = v6 ? &self->v6_cap : &self->v4_cap;
+  return_if (len + n + 1 <= *cap) 0;
+  unsigned int new_cap = max(*cap * 2, len + n + 1);
+  struct HostChain *chains = realloc(
+    v6 ? self->v6 : self->v4, sizeof(struct HostChain) * new_cap);
+  return_if_fail (chains != NULL) -1;
+  if (v6) {
+    self->v6 = chains;
+  } else {
+    self->v4 = chains;
+  }
+  *cap = new_cap;
+  return 0;
+}
+
+
+// option is one of '4', '6' and 'E'; if in_place, arg is clobbered and
+// hosts go to the arena, otherwise arg is restored before returning; on error,
+// msg tells why, for the caller to name arg or where it came from
+static int rdnstun_chains_add (
+    struct RDnsTunChains * restrict self, int option, char *arg,
+    bool in_place, const char ** restrict msg) {
+  int ret;
+  switch (option) {
+    case '4':
+    case '6': {
+      bool v6 = option == '6';
+      test_goto (rdnstun_chains_reserve(self, v6, 1) == 0, -1) fail_chain;
+      struct HostChain *chain =
+        v6 ? self->v6 + self->v6_len : self->v4 + self->v4_len;
+      goto_nonzero (in_place ?
+        HostChain_init_arena(chain, arg, v6, &self->arena) :
+        HostChain_init(chain, arg, v6)) fail_chain;
+      if (v6) {
+        self->v6_len++;
+      } else {
+        self->v4_len++;
+      }
+      self->last_v6 = v6;
+      break;
+    }
+    case 'E': {
+      test_goto (
+        (self->last_v6 ? self->v6_len : self->v4_len) > 0, 1
+      ) fail_duplicate;
+      char *step_end = strchr(arg, '/');
+      char *prefix_end = strchr(arg, ',');
+      test_goto (step_end != NULL && prefix_end != NULL, 2) fail_duplicate;
+
+      *step_end = '\0';
+      *prefix_end = '\0';
+      int step;
+      int prefix;
+      int n;
+      bool parsed_int =
+        argtoi(arg, &step, 1, SHRT_MAX) == 0 &&
+        argtoi(step_end + 1, &prefix, 1, self->last_v6 ? 128 : 32) == 0 &&
+        argtoi(prefix_end + 1, &n, 0, INT_MAX) == 0;
+      *step_end = '/';
+      *prefix_end = ',';
+      test_goto (parsed_int, 2) fail_duplicate;
+
+      struct HostChain *base = self->last_v6 ?
+        self->v6 + self->v6_len - 1 : self->v4 + self->v4_len - 1;
+      test_goto (prefix <= base->prefix, 3) fail_duplicate;
+      break_if (n == 0);
+
+      test_goto (
+        rdnstun_chains_reserve(self, self->last_v6, 1) == 0, -1
+      ) fail_duplicate;
+      base = self->last_v6 ?
+        self->v6 + self->v6_len - 1 : self->v4 + self->v4_len - 1;
+
+      // copies are not materialized, but computed on lookup
+      struct HostChain *dup = base + 1;
+      goto_nonzero (
+        HostChain_duplicate(dup, base, step, prefix, n)) fail_duplicate;
+
+      if (LOG_WOULD_LOG(LOG_LEVEL_DEBUG)) {
+        const int af = self->last_v6 ? AF_INET6 : AF_INET;
+        char s_network[INET6_ADDRSTRLEN];
+        inet_ntop(af, dup->network, s_network, sizeof(s_network));
+        LOG(LOG_LEVEL_DEBUG, "Duplicate %d chain(s): %s/%d, interval %d/%d",
+            n, s_network, dup->prefix, step, prefix);
+      }
+
+      if (self->last_v6) {
+        self->v6_len++;
+      } else {
+        self->v4_len++;
+      }
+      break;
+    }
+  }
+  return 0;
+
+  if (0) {
+fail_chain:
+    *msg = HostChain_strerror(ret);
+  }
+  if (0) {
+fail_duplicate:
+    switch (ret) {
+      case 1:
+        *msg = "'E' must be specified after a chain";
+        break;
+      case 2:
+        *msg = "malformed duplication specification";
+        break;
+      case 3:
+        *msg = "'prefix' must be less or equal than the prefix of "
+               "previous chain";
+        break;
+      default:
+        *msg = Struct_strerror(ret);
+    }
+  }
+  should (*msg != NULL) otherwise {
+    *msg = "unknown error";
+  }
+  return -1;
+}
+
+
+// lines of '-4 <chain>', '-6 <chain>' or '-E <spec>', '#' starts a comment
+static int rdnstun_chains_load (
+    struct RDnsTunChains *self, const char *path) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  should (fd >= 0) otherwise {
+    fprintf(stderr, "error: cannot open '%s': %s\n", path, strerror(errno));
+    return -1;
+  }
+  struct stat st;
+  should (fstat(fd, &st) == 0) otherwise {
+    perror("fstat");
+    close(fd);
+    return -1;
+  }
+  size_t size = st.st_size;
+  if (size == 0) {
+    close(fd);
+    return 0;
+  }
+  const char *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  should (data != MAP_FAILED) otherwise {
+    perror("mmap");
+    return -1;
+  }
+  madvise((void *) data, size, MADV_SEQUENTIAL);
+  const char *data_end = data + size;
+
+  // count chains first, so that the arrays are allocated only once
+  unsigned int n[2] = {0, 0};
+  bool last_v6 = self->last_v6;
+  for (const char *line = data, *end; line < data_end; line = end + 1) {
+    end = memchr(line, '\n', data_end - line);
+    if (end == NULL) {
+      end = data_end;
+    }
+    for (; line < end && (*line == ' ' || *line == '\t'); line++) { }
+    continue_if (end - line < 2 || line[0] != '-');
+    if (line[1] == '4' || line[1] == '6') {
+      last_v6 = line[1] == '6';
+    }
+    continue_if_not (line[1] == '4' || line[1] == '6' || line[1] == 'E');
+    n[last_v6]++;
+  }
+  int ret = -1;
+  should (rdnstun_chains_reserve(self, false, n[0]) == 0 &&
+          rdnstun_chains_reserve(self, true, n[1]) == 0) otherwise {
+    perror("realloc");
+    goto end;
+  }
+
+  ret = 0;
+  unsigned int lineno = 1;
+  for (const char *line = data, *end; line < data_end;
+       line = end + 1, lineno++) {
+    end = memchr(line, '\n', data_end - line);
+    if (end == NULL) {
+      end = data_end;
+    }
+    for (; line < end && (*line == ' ' || *line == '\t'); line++) { }
+    continue_if (line == end || *line == '\r' || *line == '#');
+
+    // the mapping is read-only, and the chain is parsed in place
+    char buf[RDNSTUN_CONFIG_LINE_MAX];
+    should (end - line < (ptrdiff_t) sizeof(buf)) otherwise {
+      fprintf(stderr, "error: %s:%u: line too long\n", path, lineno);
+      ret = -1;
+      break;
+    }
+    memcpy(buf, line, end - line);
+    buf[end - line] = '\0';
+    buf[strcspn(buf, "\r")] = '\0';
+
+    char *arg = buf + 2;
+    int option = buf[0] == '-' && buf[1] != '\0' ? buf[1] : 0;
+    should ((option == '4' || option == '6' || option == 'E') &&
+            (*arg == ' ' || *arg == '\t')) otherwise {
+      fprintf(stderr, "error: %s:%u: expect -4, -6 or -E\n", path, lineno);
+      ret = -1;
+      break;
+    }
+    arg += strspn(arg, " \t");
+    // parsing splits arg, so name the line instead
+    const char *msg;
+    should (rdnstun_chains_add(self, option, arg, true, &msg) == 0) otherwise {
+      fprintf(stderr, "error: %s:%u: %s\n", path, lineno, msg);
+      ret = -1;
+      break;
+    }
+  }
+
+end:
+  munmap((void *) data, size);
+  return ret;
+}
+
+
+static void rdnstun_tables_free (struct RDnsTunTables *self) {
+  if (self->v4.chains != NULL) {
+    HostChainTable_destroy(&self->v4);
+  }
+  if (self->v6.chains != NULL) {
+    HostChainTable_destroy(&self->v6);
+  }
+  Arena_destroy(&self->arena);
+  if (self->image.base != NULL) {
+    TableImage_destroy(&self->image);
+  }
+  free(self);
+}
+
+
+static struct RDnsTunTables *rdnstun_tables_map (const char *path) {
+  struct RDnsTunTables *tables = malloc(sizeof(struct RDnsTunTables));
+  should (tables != NULL) otherwise {
+    perror("malloc");
+    return NULL;
+  }
+  Arena_init(&tables->arena, ARENA_CHUNK_SIZE, false);
+  int ret = TableImage_init(&tables->image, path, &tables->v4, &tables->v6);
+  should (ret == 0) otherwise {
+    fprintf(stderr, "error: cannot load table '%s': %s\n",
+            path, ret < 0 ? strerror(errno) : TableImage_strerror(ret));
+    free(tables);
+    return NULL;
+  }
+  return tables;
+}
+
+
+// hosts of both tables in lookup order, in one mapping freed at once
+static void rdnstun_tables_pack (struct RDnsTunTables *self, bool huge) {
+  size_t size = 0;
+  if (self->v4.chains != NULL) {
+    size += HostChainTable_packed_size(&self->v4);
+  }
+  if (self->v6.chains != NULL) {
+    size += HostChainTable_packed_size(&self->v6);
+  }
+  struct Arena packed;
+  Arena_init(&packed, size, huge);
+  should (Arena_reserve(&packed, size) != NULL) otherwise {
+    // hosts stay where they were parsed
+    LOG_PERROR(LOG_LEVEL_NOTICE, "mmap(%zu)", size);
+    return;
+  }
+  // everything fits in the reserved chunk, so packing does not fail
+  if (self->v4.chains != NULL) {
+    promise (HostChainTable_pack(&self->v4, &packed) == 0);
+  }
+  if (self->v6.chains != NULL) {
+    promise (HostChainTable_pack(&self->v6, &packed) == 0);
+  }
+  Arena_destroy(&self->arena);
+  self->arena = packed;
+}
+
+
+// chains of the command line, then of config if not NULL, or those compiled
+// into table if not NULL; hosts are put on huge pages if huge
+static struct RDnsTunTables *rdnstun_tables_new (
+    const struct RDnsTunChainArg *args, unsigned int nargs,
+    const char *config, const char *table, bool huge) {
+  return_if (table != NULL) rdnstun_tables_map(table);
+
+  struct RDnsTunChains chains = {.v4 = NULL};
+  Arena_init(&chains.arena, ARENA_CHUNK_SIZE, false);
+  struct RDnsTunTables *tables = NULL;
+  for (unsigned int i = 0; i < nargs; i++) {
+    const char *msg;
+    should (rdnstun_chains_add(
+        &chains, args[i].option, args[i].arg, false, &msg) == 0) otherwise {
+      fprintf(stderr, "error when parsing '%s': %s\n", args[i].arg, msg);
+      goto fail;
+    }
+  }
+  if (config != NULL) {
+    goto_if_fail (rdnstun_chains_load(&chains, config) == 0) fail;
+  }
+  should (chains.v4_len != 0 || chains.v6_len != 0) otherwise {
+    fprintf(stderr, "error: must specify at least one chain\n");
+    goto fail;
+  }
+
+  tables = malloc(sizeof(struct RDnsTunTables));
+  should (tables != NULL) otherwise {
+    perror("malloc");
+    goto fail;
+  }
+  tables->v4.chains = NULL;
+  tables->v6.chains = NULL;
+  tables->image.base = NULL;
+  // hosts stay where they are, the arena moves with them
+  tables->arena = chains.arena;
+  Arena_init(&chains.arena, ARENA_CHUNK_SIZE, false);
+  if (chains.v4_len > 0) {
+    should (HostChainTable_init(
+        &tables->v4, chains.v4, chains.v4_len, false) == 0) otherwise {
+      perror("HostChainTable_init");
+      goto fail;
+    }
+    chains.v4 = NULL;
+  }
+  if (chains.v6_len > 0) {
+    should (HostChainTable_init(
+        &tables->v6, chains.v6, chains.v6_len, true) == 0) otherwise {
+      perror("HostChainTable_init");
+      goto fail;
+    }
+    chains.v6 = NULL;
+  }
+  // arrays reserved for a version without chains
+  rdnstun_chains_destroy(&chains);
+  rdnstun_tables_pack(tables, huge);
+  return tables;
+
+fail:
+  if (tables != NULL) {
+    rdnstun_tables_free(tables);
+  }
+  rdnstun_chains_destroy(&chains);
+  return NULL;
+}
+
+
+struct RDnsTunReloadArg {
+  const struct RDnsTunChainArg *args;
+  unsigned int nargs;
+  const char *config;
+  const char *table;
+  bool huge_pages;
+  int shutdownfd;
+};
+
+
+static int rdnstun_reloader (void *arg) {
+  const struct RDnsTunReloadArg *reload_arg = arg;
+  threadname_set("reload");
+  rdnstun_sigmask(SIG_BLOCK);
+
+  struct pollfd pollfds[2] = {
+    {.fd = rdnstun_reloadfd, .events = POLLIN},
+    {.fd = reload_arg->shutdownfd, .events = POLLIN},
+  };
+  while (1) {
+    continue_if (poll(pollfds, arraysize(pollfds), -1) < 0);
+    break_if_fail (pollfds[1].revents == 0);
+    continue_if_not (pollfds[0].revents != 0);
+    eventfd_t value;
+    eventfd_read(rdnstun_reloadfd, &value);
+
+    LOG(LOG_LEVEL_INFO, "Reloading chains");
+    // built off the hot path, workers only ever see complete tables
+    struct RDnsTunTables *tables = rdnstun_tables_new(
+      reload_arg->args, reload_arg->nargs, reload_arg->config,
+      reload_arg->table, reload_arg->huge_pages);
+    should (tables != NULL) otherwise {
+      LOG(LOG_LEVEL_WARNING, "Failed to reload chains, keep the old ones");
+      continue;
+    }
+    tables = atomic_exchange(&rdnstun_tables, tables);
+    Epoch_synchronize(&rdnstun_epoch);
+    rdnstun_tables_free(tables);
+    LOG(LOG_LEVEL_NOTICE, "Reloaded chains");
+  }
+  return 0;
 }
 
 
@@ -149,14 +1032,26 @@ static void usage (const char *progname) {
 "\n"
 "  -4 <v4addr_chain>       IPv4 address chain\n"
 "  -6 <v6addr_chain>       IPv6 address chain\n"
+"  -c <file>               read more chains from <file>, one option per line,\n"
+"                          e.g. '-4 <v4addr_chain>'; reread on SIGHUP\n"
+"  --compile <file>        write the indexed chains to <file> and exit\n"
+"  --table <file>          serve the chains compiled into <file> instead;\n"
+"                          remapped on SIGHUP, so replace it by renaming\n"
+"  --huge-pages            put hosts on huge pages if available\n"
 "  -E <step>/<prefix>,<n>  duplicates the previous chain by <n>, with interval of\n"
 "                          <step>*2^<prefix>. All route and hosts will be shifted\n"
 "  -T <nthread>            run <nthread> threads (0 for `nproc')\n"
 "                          If <iface> is a persist tun device, it must be\n"
 "                          created using multi_queue.\n"
+"  -U                      use io_uring for tun I/O, fall back to poll() if\n"
+"                          not available\n"
 "  -D                      daemonize (run in background)\n"
 "  -d                      enables debugging messages\n"
-"  -h                      prints this help text\n", stderr);
+"  --async-log             format per-packet debugging messages in a\n"
+"                          background thread, dropped if it falls behind\n"
+"  -h                      prints this help text\n"
+"\n"
+"Send SIGUSR1 to log percentiles of reply latency.\n", stderr);
 }
 
 
@@ -173,107 +1068,80 @@ int main (int argc, char *argv[]) {
 #pragma GCC diagnostic pop
   diagnose_sigsegv(true, 0, NULL);
 
-  struct HostChain *v4_chains = NULL;
-  struct HostChain *v6_chains = NULL;
-  unsigned int v4_chains_len = 0;
-  unsigned int v6_chains_len = 0;
+  struct RDnsTunChainArg *chain_args = NULL;
+  unsigned int nchain_args = 0;
+  const char *config = NULL;
+  const char *compile = NULL;
+  const char *table = NULL;
+  bool huge_pages = false;
+  bool async_log = false;
+  struct StatsSegment stats = {.header = NULL};
   char if_name[IF_NAMESIZE] = RDNSTUN_IFACE_NAME;
   int nthread = -1;
+  bool uring = false;
   bool background = false;
 
   // Parse command line options
+  enum {
+    OPTION_COMPILE = 256,
+    OPTION_TABLE,
+    OPTION_HUGE_PAGES,
+    OPTION_ASYNC_LOG,
+  };
+  static const struct option long_options[] = {
+    {"compile", required_argument, NULL, OPTION_COMPILE},
+    {"table", required_argument, NULL, OPTION_TABLE},
+    {"huge-pages", no_argument, NULL, OPTION_HUGE_PAGES},
+    {"async-log", no_argument, NULL, OPTION_ASYNC_LOG},
+    {NULL, 0, NULL, 0},
+  };
   bool if_name_set = false;
-  bool last_chain_v6 = false;
-  for (int option; (option = getopt(argc, argv, "-4:6:E:T:Ddh")) != -1;) {
-    int ret;
+  for (int option; (option = getopt_long(
+         argc, argv, "-4:6:E:c:T:UDdh", long_options, NULL)) != -1;) {
     switch (option) {
       case 1:
         should (!if_name_set) otherwise {
           fprintf(stderr, "error: too many positional options\n");
-          goto fail_arg;
+          goto fail;
         }
         if_name_set = true;
         should (strnlen(optarg, sizeof(if_name)) < sizeof(if_name)) otherwise {
           fprintf(stderr, "error: iface name '%s' too long\n", optarg);
-          goto fail_arg;
+          goto fail;
         }
         strcpy(if_name, optarg);
         break;
-      case '4': {
-        test_goto (irealloc(
-          &v4_chains, sizeof(struct HostChain) * (v4_chains_len + 2)
-        ) != NULL, -1) fail_chain;
-        goto_nonzero (
-          HostChain_init(v4_chains + v4_chains_len, optarg, false)) fail_chain;
-        v4_chains_len++;
-        last_chain_v6 = false;
+      case '4':
+      case '6':
+      case 'E':
+        // parsed with the config file, and again on each reload
+        should (irealloc(&chain_args, sizeof(struct RDnsTunChainArg) * (
+            nchain_args + 1)) != NULL) otherwise {
+          perror("realloc");
+          goto fail;
+        }
+        chain_args[nchain_args++] =
+          (struct RDnsTunChainArg) {.option = option, .arg = optarg};
         break;
-      }
-      case '6': {
-        test_goto (irealloc(
-          &v6_chains, sizeof(struct HostChain) * (v6_chains_len + 2)
-        ) != NULL, -1) fail_chain;
-        goto_nonzero (
-          HostChain_init(v6_chains + v6_chains_len, optarg, true)) fail_chain;
-        v6_chains_len++;
-        last_chain_v6 = true;
+      case 'c':
+        config = optarg;
         break;
-      }
-      case 'E': {
-        test_goto (
-          (last_chain_v6 ? v6_chains_len : v4_chains_len) > 0, 1
-        ) fail_duplicate;
-        char *step_end = strchr(optarg, '/');
-        char *prefix_end = strchr(optarg, ',');
-        test_goto (step_end != NULL && prefix_end != NULL, 2) fail_duplicate;
-
-        *step_end = '\0';
-        *prefix_end = '\0';
-        int step;
-        int prefix;
-        int n;
-        bool parsed_int =
-          argtoi(optarg, &step, 1, SHRT_MAX) == 0 &&
-          argtoi(step_end + 1, &prefix, 1, last_chain_v6 ? 128 : 32) == 0 &&
-          argtoi(prefix_end + 1, &n, 0, INT_MAX) == 0;
-        *step_end = '/';
-        *prefix_end = ',';
-        test_goto (parsed_int, 2) fail_duplicate;
-
-        test_goto (irealloc(
-          (void **) (last_chain_v6 ? &v6_chains : &v4_chains),
-          sizeof(struct HostChain) * (
-            (last_chain_v6 ? v6_chains_len : v4_chains_len) + n + 1)
-        ) != NULL, -1) fail_duplicate;
-        struct HostChain *base = last_chain_v6 ?
-          v6_chains + v6_chains_len - 1 : v4_chains + v4_chains_len - 1;
-        test_goto (prefix <= base->prefix, 3) fail_duplicate;
-
-        const int af = last_chain_v6 ? AF_INET6 : AF_INET;
-        for (int i = 1; i <= n; i++) {
-          struct HostChain *self = base + i;
-          goto_nonzero (HostChain_copy(self, base)) fail_duplicate;
-          HostChain_shift(self, step * i, prefix);
-
-          if (LOG_WOULD_LOG(LOG_LEVEL_DEBUG)) {
-            char s_network[INET6_ADDRSTRLEN];
-            inet_ntop(af, self->network, s_network, sizeof(s_network));
-            LOG(LOG_LEVEL_DEBUG, "Duplicate # %d chain: %s/%d",
-                i, s_network, self->prefix);
-          }
-
-          if (last_chain_v6) {
-            v6_chains_len++;
-          } else {
-            v4_chains_len++;
-          }
-        }
+      case OPTION_COMPILE:
+        compile = optarg;
+        break;
+      case OPTION_TABLE:
+        table = optarg;
+        break;
+      case OPTION_HUGE_PAGES:
+        huge_pages = true;
+        break;
+      case OPTION_ASYNC_LOG:
+        async_log = true;
         break;
-      }
       case 'T':
         should (argtoi(optarg, &nthread, 0, 1024) == 0) otherwise {
           fprintf(stderr, "error: number of threads not a positive number\n");
-          goto fail_arg;
+          goto fail;
         }
         if (nthread == 0) {
           nthread = sysconf(_SC_NPROCESSORS_ONLN);
@@ -282,10 +1150,17 @@ int main (int argc, char *argv[]) {
           }
         }
         break;
+      case 'U':
+        uring = true;
+        break;
       case 'D':
         background = true;
         break;
       case 'd':
+        if (LOG_COMPILE_LEVEL < LOG_LEVEL_DEBUG) {
+          fprintf(stderr, "warning: debugging messages are not compiled in, "
+                          "rebuild with LOG_COMPILE_LEVEL=7\n");
+        }
         LOGGER_SET_ATTRIBUTE(level, LOG_LEVEL_DEBUG);
         break;
       case 'h':
@@ -294,67 +1169,67 @@ int main (int argc, char *argv[]) {
       default:
         // getopt already print error for us
         // fprintf(stderr, "error: unknown option '%c'\n", option);
-        if (0) {
-          const char *msg;
-          if (0) {
-fail_chain:
-            msg = HostChain_strerror(ret);
-          }
-          if (0) {
-fail_duplicate:
-            switch (ret) {
-              case 1:
-                msg = "'E' must be specified after a chain";
-                break;
-              case 2:
-                msg = "malformed duplication specification";
-                break;
-              case 3:
-                msg = "'prefix' must be less or equal than the prefix of "
-                      "previous chain";
-                break;
-              default:
-                msg = Struct_strerror(ret);
-            }
-          }
-          should (msg != NULL) otherwise {
-            msg = "unknown error";
-          }
-          fprintf(stderr, "error when parsing '%s': %s\n", optarg, msg);
-        }
-fail_arg:
         goto fail;
     }
   }
 
-  should (v4_chains_len != 0 || v6_chains_len != 0) otherwise {
-    fprintf(stderr, "error: must specify at least one chain\n");
+  should (table == NULL || (
+      nchain_args == 0 && config == NULL && compile == NULL)) otherwise {
+    fprintf(stderr, "error: --table cannot be used with other chains\n");
     goto fail;
   }
-  if (v4_chains != NULL) {
-    if (v4_chains_len == 0) {
-      free(v4_chains);
-      v4_chains = NULL;
-    } else {
-      memset(v4_chains + v4_chains_len, 0, sizeof(struct HostChain));
-      HostChainArray_sort(v4_chains);
+  {
+    struct RDnsTunTables *tables =
+      rdnstun_tables_new(chain_args, nchain_args, config, table, huge_pages);
+    goto_if_fail (tables != NULL) fail;
+    atomic_store(&rdnstun_tables, tables);
+  }
+  if (compile != NULL) {
+    const struct RDnsTunTables *tables = atomic_load(&rdnstun_tables);
+    should (TableImage_write(
+        compile, tables->v4.chains == NULL ? NULL : &tables->v4,
+        tables->v6.chains == NULL ? NULL : &tables->v6) == 0) otherwise {
+      perror(compile);
+      goto fail;
     }
+    goto end;
   }
-  if (v6_chains != NULL) {
-    if (v6_chains_len == 0) {
-      free(v6_chains);
-      v4_chains = NULL;
-    } else {
-      memset(v6_chains + v6_chains_len, 0, sizeof(struct HostChain));
-      HostChainArray_sort(v6_chains);
+
+  // shutdown notifier
+  rdnstun_shutdownfd = eventfd(0, EFD_CLOEXEC);
+  should (rdnstun_shutdownfd >= 0) otherwise {
+    perror("eventfd");
+    goto fail;
+  }
+  // reload notifier
+  bool reloadable = config != NULL || table != NULL;
+  if (reloadable) {
+    rdnstun_reloadfd = eventfd(0, EFD_CLOEXEC);
+    should (rdnstun_reloadfd >= 0) otherwise {
+      perror("eventfd");
+      goto fail;
     }
   }
 
   {
     // initialize tun/tap interface
     bool multithread = nthread > 0;
-    nthread = max(nthread, 1);
+    if (!multithread) {
+      nthread = 1;
+    }
+    should (Epoch_init(&rdnstun_epoch, nthread) == 0) otherwise {
+      perror("aligned_alloc");
+      goto fail;
+    }
     int tunfds[nthread];
+    struct RDnsTunArg args[nthread];
+    thrd_t reloader;
+    bool reloading = false;
+    struct RDnsTunReloadArg reload_arg = {
+      .args = chain_args, .nargs = nchain_args, .config = config,
+      .table = table, .huge_pages = huge_pages,
+      .shutdownfd = rdnstun_shutdownfd,
+    };
     if (!multithread) {
       tunfds[0] = tun_alloc(if_name, IFF_TUN);
       goto_if_fail (tunfds[0] >= 0) fail;
@@ -378,6 +1253,19 @@ fail_arg:
       LOG(LOG_LEVEL_NOTICE, "Failed to bring up interface %s", if_name);
     }
 
+    // counters
+    latency_init();
+    char stats_name[NAME_MAX];
+    snprintf(stats_name, sizeof(stats_name), RDNSTUN_STATS_NAME, if_name);
+    should (StatsSegment_init(&stats, stats_name, nthread) == 0) otherwise {
+      LOG_PERROR(LOG_LEVEL_NOTICE, "shm_open(%s)", stats_name);
+      should (StatsSegment_init(&stats, NULL, nthread) == 0) otherwise {
+        perror("mmap");
+        stats.header = NULL;
+        goto fail_tun;
+      }
+    }
+
     // daemonize
     if (background) {
       should (daemon(0, 0) == 0) otherwise {
@@ -386,6 +1274,16 @@ fail_arg:
       }
     }
 
+    // inherited by every thread, workers unblock them
+    rdnstun_sigmask(SIG_BLOCK);
+
+    // threads do not survive daemon()
+    if (async_log) {
+      should (LOGGER_ASYNC_START() == 0) otherwise {
+        LOG_PERROR(LOG_LEVEL_NOTICE, "Failed to start log thread");
+      }
+    }
+
     // main loop
     if (!background) {
       LOGEVENT (LOG_LEVEL_NOTICE) {
@@ -395,25 +1293,40 @@ fail_arg:
         }
       }
     }
+    rdnstun_stats = &stats;
     signal(SIGINT, shutdown_rdnstun);
+    signal(SIGUSR1, request_report);
+    if (reloadable) {
+      should (thrd_create(
+          &reloader, rdnstun_reloader, &reload_arg) == 0) otherwise {
+        perror("thrd_create");
+        goto fail_tun;
+      }
+      reloading = true;
+      signal(SIGHUP, reload_rdnstun);
+    } else {
+      signal(SIGHUP, ignore_reload);
+    }
+    for (int i = 0; i < nthread; i++) {
+      args[i].tunfd = tunfds[i];
+      args[i].shutdownfd = rdnstun_shutdownfd;
+      args[i].reader = rdnstun_epoch.readers + i;
+      args[i].uring = uring;
+      args[i].stats = stats.threads + i;
+    }
     if (nthread == 1) {
       char name[THREADNAME_SIZE];
       threadname_get(name, sizeof(name));
-      rdnstun(tunfds[0], v4_chains, v6_chains, &rdnstun_shutdown);
+      start_rdnstun(args);
       threadname_set(name);
       close(tunfds[0]);
     } else {
       thrd_t threads[nthread];
-      struct RDnsTunArg args[nthread];
       for (int i = 0; i < nthread; i++) {
-        args[i].tunfd = tunfds[i];
-        args[i].v4_chains = v4_chains;
-        args[i].v6_chains = v6_chains;
-        args[i].shutdown = &rdnstun_shutdown;
         should (thrd_create(
             &threads[i], start_rdnstun, args + i) == 0) otherwise {
           perror("thrd_create");
-          rdnstun_shutdown = true;
+          eventfd_write(rdnstun_shutdownfd, 1);
           for (i--; i >= 0; i--) {
             thrd_join(threads[i], NULL);
           }
@@ -425,9 +1338,18 @@ fail_arg:
         close(tunfds[i]);
       }
     }
+    if (reloading) {
+      // workers may also stop on error
+      eventfd_write(rdnstun_shutdownfd, 1);
+      thrd_join(reloader, NULL);
+    }
 
     if (0) {
 fail_tun:
+      if (reloading) {
+        eventfd_write(rdnstun_shutdownfd, 1);
+        thrd_join(reloader, NULL);
+      }
       for (int i = 0; i < nthread; i++) {
         close(tunfds[i]);
       }
@@ -442,13 +1364,27 @@ end:
 fail:
     ret = EXIT_FAILURE;
   }
-  if (v4_chains != NULL) {
-    HostChainArray_destroy_size(v4_chains, v4_chains_len);
-    free(v4_chains);
+  if (app_logger.async) {
+    LOGGER_ASYNC_STOP();
+  }
+  if (rdnstun_shutdownfd >= 0) {
+    close(rdnstun_shutdownfd);
+  }
+  if (rdnstun_reloadfd >= 0) {
+    close(rdnstun_reloadfd);
   }
-  if (v6_chains != NULL) {
-    HostChainArray_destroy_size(v6_chains, v6_chains_len);
-    free(v6_chains);
+  if (stats.header != NULL) {
+    StatsSegment_destroy(&stats);
+  }
+  if (rdnstun_epoch.readers != NULL) {
+    Epoch_destroy(&rdnstun_epoch);
+  }
+  {
+    struct RDnsTunTables *tables = atomic_load(&rdnstun_tables);
+    if (tables != NULL) {
+      rdnstun_tables_free(tables);
+    }
   }
+  free(chain_args);
   return ret;
 }
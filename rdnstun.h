@@ -4,7 +4,12 @@
 
 #define RDNSTUN_NAME "rdnstun"
 #define RDNSTUN_IFACE_NAME "tun-rdns"
-#define RDNSTUN_SLEEP_TIME 1
+#define RDNSTUN_STATS_NAME "/" RDNSTUN_NAME ".%s"
+#define RDNSTUN_URING_NBUF 16
+#define RDNSTUN_URING_BUFSIZE (IP_MAXPACKET + 1)
+// packets a busy poll() worker handles between checks of its wakeup fds
+#define RDNSTUN_DRAIN_INTERVAL 256
+#define RDNSTUN_CONFIG_LINE_MAX 16384
 
 
 #endif /* RDNSTUN_H */
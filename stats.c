@@ -0,0 +1,148 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "macro.h"
+#include "stats.h"
+
+
+// threads start on their own cache line
+#define STATS_HEADER_SIZE 64
+
+
+const char *const StatsCounter_names[STATS_MAX] = {
+  [STATS_READ] = "read",
+  [STATS_REPLY_ECHO] = "reply_echo",
+  [STATS_REPLY_TIME_EXCEEDED] = "reply_time_exceeded",
+  [STATS_REPLY_UNREACH_HOST] = "reply_unreach_host",
+  [STATS_REPLY_UNREACH_PORT] = "reply_unreach_port",
+  [STATS_DROP_NO_HOST] = "drop_no_host",
+  [STATS_DROP_TTL_ZERO] = "drop_ttl_zero",
+  [STATS_DROP_HOST_TTL] = "drop_host_ttl",
+  [STATS_DROP_FILTERED] = "drop_filtered",
+  [STATS_DROP_OTHER] = "drop_other",
+  [STATS_DROP_IPVER] = "drop_ipver",
+  [STATS_DROP_IGNORED] = "drop_ignored",
+  [STATS_READ_ERROR] = "read_error",
+  [STATS_WRITE_ERROR] = "write_error",
+  [STATS_SHORT_WRITE] = "short_write",
+  [STATS_POLL_ERROR] = "poll_error",
+  [STATS_CACHE_HIT] = "cache_hit",
+  [STATS_CACHE_MISS] = "cache_miss",
+};
+
+
+void StatsThread_publish (
+    struct StatsThread * restrict self, const uint64_t * restrict counters) {
+  // only this thread writes seq
+  unsigned int seq = self->seq;
+  __atomic_store_n(&self->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  memcpy(self->counters, counters, sizeof(self->counters));
+  __atomic_store_n(&self->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+
+int StatsThread_read (
+    const struct StatsThread * restrict self, uint64_t * restrict counters) {
+  // a writer that died while publishing leaves seq odd
+  for (unsigned int i = 0; i < 1u << 16; i++) {
+    unsigned int seq = __atomic_load_n(&self->seq, __ATOMIC_ACQUIRE);
+    continue_if (seq % 2 != 0);
+    memcpy(counters, self->counters, sizeof(self->counters));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return_if (__atomic_load_n(&self->seq, __ATOMIC_RELAXED) == seq) 0;
+  }
+  return -1;
+}
+
+
+void StatsSegment_destroy (struct StatsSegment *self) {
+  munmap(self->header, self->size);
+  if (self->name[0] != '\0') {
+    shm_unlink(self->name);
+  }
+}
+
+
+int StatsSegment_open (struct StatsSegment *self, const char *name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  return_if_fail (fd >= 0) -1;
+  struct stat st;
+  should (fstat(fd, &st) == 0) otherwise {
+    close(fd);
+    return -1;
+  }
+  should (st.st_size >= STATS_HEADER_SIZE) otherwise {
+    close(fd);
+    errno = EPROTO;
+    return -1;
+  }
+  self->size = st.st_size;
+  self->header = mmap(NULL, self->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return_if_fail (self->header != MAP_FAILED) -1;
+  self->threads = (void *) ((char *) self->header + STATS_HEADER_SIZE);
+  self->name[0] = '\0';
+
+  const struct StatsSegmentHeader *header = self->header;
+  should (__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) == STATS_MAGIC &&
+          header->version == STATS_VERSION &&
+          header->ncounter == STATS_MAX &&
+          header->nbucket == LATENCYHIST_SIZE &&
+          header->nthread <= (self->size - STATS_HEADER_SIZE) /
+                             sizeof(struct StatsThread)) otherwise {
+    munmap(self->header, self->size);
+    errno = EPROTO;
+    return -1;
+  }
+  return 0;
+}
+
+
+int StatsSegment_init (
+    struct StatsSegment *self, const char *name, unsigned int nthread) {
+  self->size = STATS_HEADER_SIZE + sizeof(struct StatsThread) * nthread;
+  self->name[0] = '\0';
+  if (name == NULL) {
+    // private, just for the workers to write into
+    self->header = mmap(NULL, self->size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return_if_fail (self->header != MAP_FAILED) -1;
+  } else {
+    return_if_fail (strlen(name) < sizeof(self->name)) -1;
+    int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    return_if_fail (fd >= 0) -1;
+    should (ftruncate(fd, self->size) == 0) otherwise {
+      close(fd);
+      shm_unlink(name);
+      return -1;
+    }
+    self->header = mmap(NULL, self->size, PROT_READ | PROT_WRITE,
+                        MAP_SHARED, fd, 0);
+    close(fd);
+    should (self->header != MAP_FAILED) otherwise {
+      shm_unlink(name);
+      return -1;
+    }
+    strcpy(self->name, name);
+  }
+  self->threads = (void *) ((char *) self->header + STATS_HEADER_SIZE);
+
+  for (unsigned int i = 0; i < nthread; i++) {
+    self->threads[i].tunfd = -1;
+  }
+  self->header->version = STATS_VERSION;
+  self->header->ncounter = STATS_MAX;
+  self->header->nthread = nthread;
+  self->header->nbucket = LATENCYHIST_SIZE;
+  self->header->ns_per_tick = latency_ns_per_tick;
+  // readers check magic first
+  __atomic_store_n(&self->header->magic, STATS_MAGIC, __ATOMIC_RELEASE);
+  return 0;
+}
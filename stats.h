@@ -0,0 +1,91 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
+
+#include "latency.h"
+
+
+#define STATS_MAGIC 0x534e4452  /* "RDNS" */
+#define STATS_VERSION 3
+
+
+enum StatsCounter {
+  STATS_READ,
+  STATS_REPLY_ECHO,
+  STATS_REPLY_TIME_EXCEEDED,
+  STATS_REPLY_UNREACH_HOST,
+  STATS_REPLY_UNREACH_PORT,
+  // error 17 to 20 of HostChainTable_reply
+  STATS_DROP_NO_HOST,
+  STATS_DROP_TTL_ZERO,
+  STATS_DROP_HOST_TTL,
+  STATS_DROP_FILTERED,
+  STATS_DROP_OTHER,
+  // unknown IP version or no chain of that version
+  STATS_DROP_IPVER,
+  // ICMP other than echo request to a host
+  STATS_DROP_IGNORED,
+  STATS_READ_ERROR,
+  STATS_WRITE_ERROR,
+  STATS_SHORT_WRITE,
+  STATS_POLL_ERROR,
+  STATS_CACHE_HIT,
+  STATS_CACHE_MISS,
+  STATS_MAX
+};
+
+extern const char *const StatsCounter_names[STATS_MAX];
+
+
+// one writer per slot, readers retry while seq is odd or changed
+struct StatsThread {
+  unsigned int seq;
+  int tunfd;
+  uint64_t counters[STATS_MAX];
+  // from read() to write() of each reply, written in place
+  struct LatencyHist latency __attribute__((aligned(64)));
+} __attribute__((aligned(64)));
+
+__attribute__((nonnull, access(read_only, 2)))
+void StatsThread_publish (
+  struct StatsThread * restrict self, const uint64_t * restrict counters);
+__attribute__((nonnull, warn_unused_result, access(write_only, 2)))
+int StatsThread_read (
+  const struct StatsThread * restrict self, uint64_t * restrict counters);
+
+
+/***/
+
+struct StatsSegmentHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t ncounter;
+  uint32_t nthread;
+  uint32_t nbucket;
+  double ns_per_tick;
+};
+
+struct StatsSegment {
+  struct StatsSegmentHeader *header;
+  struct StatsThread *threads;
+  size_t size;
+  // shm name to unlink on destroy, empty if not owned
+  char name[NAME_MAX];
+};
+
+
+__attribute__((nonnull))
+void StatsSegment_destroy (struct StatsSegment *self);
+__attribute__((nonnull, warn_unused_result, access(read_only, 2)))
+int StatsSegment_open (struct StatsSegment *self, const char *name);
+// records latency_ns_per_tick, so call latency_init() first
+__attribute__((nonnull(1), warn_unused_result, access(read_only, 2)))
+int StatsSegment_init (
+  struct StatsSegment *self, const char *name, unsigned int nthread);
+
+
+#endif /* STATS_H */
@@ -0,0 +1,476 @@
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+
+#include "macro.h"
+#include "inet.h"
+#include "probe.h"
+#include "host.h"
+#include "chain.h"
+#include "dir24.h"
+#include "filter.h"
+#include "hash.h"
+#include "trie.h"
+#include "table.h"
+#include "cache.h"
+
+
+// chains sort from the most specific route, so a /0 one is last
+static inline bool HostChainTable_has_default (
+    const struct HostChainTable *self) {
+  return self->nchain > 0 && self->chains[self->nchain - 1].prefix == 0;
+}
+
+
+// the last chain of the least specific route holding addr, or NULL
+static const struct HostChain *HostChainTable_route_last (
+    const struct HostChainTable * restrict self, const void * restrict addr) {
+  // a default route is the least specific route of every address
+  return_if (HostChainTable_has_default(self)) self->chains + self->nchain - 1;
+#ifndef NO_DIR24
+  if (self->dir.tbl24 != NULL) {
+    unsigned int i = RouteDir24_lookup(&self->dir, addr);
+    return i == ROUTEDIR24_NONE ? NULL : self->chains + i;
+  }
+#endif
+  unsigned int node = RouteTrie_lookup(&self->trie, addr);
+  return_if (node == ROUTETRIE_NONE) NULL;
+  for (unsigned int parent;
+       (parent = RouteTrie_parent(&self->trie, node)) != ROUTETRIE_NONE;
+       node = parent) { }
+  const struct HostChain *first =
+    self->chains + RouteTrie_value(&self->trie, node);
+  const struct HostChain *chain = first;
+  while (chain[1]._buf != NULL && HostChain_compare(chain + 1, first) == 0) {
+    chain++;
+  }
+  return chain;
+}
+
+
+// the last chain of the least specific route matching addr, or NULL
+static const struct HostChain *HostChainTable_last (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    unsigned int *dup) {
+  const struct HostChain *chain = HostChainTable_route_last(self, addr);
+  *dup = 0;
+  for (unsigned int v = 0; v < self->nvchain; v++) {
+    const struct HostChain *vchain = self->vchains + v;
+    continue_if (chain != NULL && chain->prefix < vchain->prefix);
+    int j = HostChain_dup_index(vchain, addr);
+    continue_if (j < 0);
+    chain = vchain;
+    *dup = j;
+  }
+  return chain;
+}
+
+
+static inline __attribute__((always_inline)) void *BaseHostChainTable_host (
+    const struct HostChain *chain, unsigned int dup, unsigned char pos,
+    void * restrict scratch, bool v6) {
+  PROBE(chain_selected, v6 ? 6 : 4, chain->network, chain->prefix, dup, pos);
+  if (v6) {
+    HostChain6_get(chain, pos, scratch);
+  } else {
+    HostChain4_get(chain, pos, scratch);
+  }
+  return_if (dup == 0) scratch;
+  // shift the copy
+  void *addr = v6 ?
+    (void *) &((struct FakeHost6 *) scratch)->addr :
+    (void *) &((struct FakeHost *) scratch)->addr;
+  inet_shift(v6 ? AF_INET6 : AF_INET, addr,
+             (long long) dup * chain->dup_step, chain->dup_prefix);
+  BaseFakeHost_prepare(scratch, addr, v6);
+  return scratch;
+}
+
+
+static inline __attribute__((always_inline)) void *BaseHostChainTable_find (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch,
+    bool v6) {
+  const struct HostChain *chain = NULL;
+  unsigned int dup = 0;
+  unsigned char pos = 0;
+
+  // matching chains are visited from the most specific route, which is also
+  // the order in the sorted array, so the first hit is the lowest index
+  unsigned int hit = UINT_MAX;
+  unsigned int i = HostHash_start(&self->hash, addr, v6);
+  for (const struct HostHashSlot *slot;
+       (slot = HostHash_next(&self->hash, addr, &i, v6)) != NULL;) {
+    continue_if_not (slot->index < ttl);
+    continue_if_not (
+      slot->chain < hit || (slot->chain == hit && slot->index < pos));
+    continue_if_not (HostChain_in(self->chains + slot->chain, addr));
+    hit = slot->chain;
+    pos = slot->index;
+  }
+  if (hit != UINT_MAX) {
+    chain = self->chains + hit;
+  }
+
+  // a copy of a virtual chain wins with a strictly longer route
+  for (unsigned int v = 0; v < self->nvchain; v++) {
+    const struct HostChain *vchain = self->vchains + v;
+    continue_if (chain != NULL && chain->prefix >= vchain->prefix);
+    int j = HostChain_dup_index(vchain, addr);
+    continue_if (j < 0);
+    // look up as if in the first copy
+    struct in6_addr key;
+    memcpy(&key, addr,
+           v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
+    inet_shift(v6 ? AF_INET6 : AF_INET, &key,
+               -(long long) j * vchain->dup_step, vchain->dup_prefix);
+    int vpos = v6 ?
+      HostChain6_find(vchain, &key, ttl) :
+      HostChain4_find(vchain, (const struct in_addr *) &key, ttl);
+    continue_if (vpos < 0);
+    chain = vchain;
+    dup = j;
+    pos = vpos;
+  }
+
+  if (chain == NULL) {
+    // otherwise the last hop within TTL of the least specific chain replies
+    chain = HostChainTable_last(self, addr, &dup);
+    return_if (chain == NULL) NULL;
+    return_if_fail (chain->len > 0) NULL;
+    pos = min(ttl, chain->len) - 1;
+  }
+
+  *index = pos;
+  return BaseHostChainTable_host(chain, dup, pos, scratch, v6);
+}
+
+
+static inline __attribute__((always_inline)) int BaseHostChainTable_resolve (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    struct HostChainRoute * restrict route, bool v6) {
+  route->chain = NULL;
+  route->dup = 0;
+  route->pos = 0;
+
+  unsigned int i = HostHash_start(&self->hash, addr, v6);
+  for (const struct HostHashSlot *slot;
+       (slot = HostHash_next(&self->hash, addr, &i, v6)) != NULL;) {
+    const struct HostChain *chain = self->chains + slot->chain;
+    continue_if_not (HostChain_in(chain, addr));
+    if (route->chain == NULL) {
+      route->chain = chain;
+      route->pos = slot->index;
+    } else {
+      // which one replies depends on TTL
+      return_if (route->chain != chain) 1;
+      route->pos = min(route->pos, slot->index);
+    }
+  }
+
+  for (unsigned int v = 0; v < self->nvchain; v++) {
+    const struct HostChain *vchain = self->vchains + v;
+    int j = HostChain_dup_index(vchain, addr);
+    continue_if (j < 0);
+    struct in6_addr key;
+    memcpy(&key, addr,
+           v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr));
+    inet_shift(v6 ? AF_INET6 : AF_INET, &key,
+               -(long long) j * vchain->dup_step, vchain->dup_prefix);
+    int vpos = v6 ?
+      HostChain6_find(vchain, &key, UCHAR_MAX) :
+      HostChain4_find(vchain, (const struct in_addr *) &key, UCHAR_MAX);
+    continue_if (vpos < 0);
+    return_if (route->chain != NULL) 1;
+    route->chain = vchain;
+    route->dup = j;
+    route->pos = vpos;
+  }
+
+  route->last = HostChainTable_last(self, addr, &route->last_dup);
+  return 0;
+}
+
+
+static inline __attribute__((always_inline)) void *BaseHostChainTable_route (
+    const struct HostChainRoute * restrict route, unsigned char ttl,
+    unsigned char *index, void * restrict scratch, bool v6) {
+  const struct HostChain *chain = route->chain;
+  unsigned int dup = route->dup;
+  unsigned char pos = route->pos;
+  if (chain == NULL || pos >= ttl) {
+    chain = route->last;
+    return_if (chain == NULL) NULL;
+    return_if_fail (chain->len > 0) NULL;
+    dup = route->last_dup;
+    pos = min(ttl, chain->len) - 1;
+  }
+  *index = pos;
+  return BaseHostChainTable_host(chain, dup, pos, scratch, v6);
+}
+
+
+void *HostChainTable4_find (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch) {
+  return BaseHostChainTable_find(self, addr, ttl, index, scratch, false);
+}
+
+
+void *HostChainTable6_find (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch) {
+  return BaseHostChainTable_find(self, addr, ttl, index, scratch, true);
+}
+
+
+void *HostChainTable_find (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    unsigned char ttl, unsigned char *index, void * restrict scratch) {
+  return self->v6 ?
+    HostChainTable6_find(self, addr, ttl, index, scratch) :
+    HostChainTable4_find(self, addr, ttl, index, scratch);
+}
+
+
+int HostChainTable4_resolve (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    struct HostChainRoute * restrict route) {
+  return BaseHostChainTable_resolve(self, addr, route, false);
+}
+
+
+int HostChainTable6_resolve (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    struct HostChainRoute * restrict route) {
+  return BaseHostChainTable_resolve(self, addr, route, true);
+}
+
+
+int HostChainTable_resolve (
+    const struct HostChainTable * restrict self, const void * restrict addr,
+    struct HostChainRoute * restrict route) {
+  return self->v6 ?
+    HostChainTable6_resolve(self, addr, route) :
+    HostChainTable4_resolve(self, addr, route);
+}
+
+
+void *HostChainTable4_route (
+    const struct HostChainRoute * restrict route, unsigned char ttl,
+    unsigned char *index, void * restrict scratch) {
+  return BaseHostChainTable_route(route, ttl, index, scratch, false);
+}
+
+
+void *HostChainTable6_route (
+    const struct HostChainRoute * restrict route, unsigned char ttl,
+    unsigned char *index, void * restrict scratch) {
+  return BaseHostChainTable_route(route, ttl, index, scratch, true);
+}
+
+
+int HostChainTable4_reply (
+    const struct HostChainTable * restrict self,
+    struct HostChainCache *cache, void *packet, unsigned short *len) {
+  const struct ip *receive = packet;
+  return_if_fail (receive->ip_ttl > 0) 18;
+  return_if_not (RouteFilter_has(&self->filter, &receive->ip_dst, false)) 20;
+  unsigned char index;
+  struct FakeHost scratch;
+  const struct FakeHost *host = cache == NULL ?
+    HostChainTable4_find(
+      self, &receive->ip_dst, receive->ip_ttl, &index, &scratch) :
+    HostChainCache4_find(
+      cache, self, &receive->ip_dst, receive->ip_ttl, &index, &scratch);
+  return_if_fail (host != NULL) 17;
+  int ret = FakeHost_reply(host, index, packet, len);
+  if (ret > 0) {
+    ret += 18;
+  }
+  return ret;
+}
+
+
+int HostChainTable6_reply (
+    const struct HostChainTable * restrict self,
+    struct HostChainCache *cache, void *packet, unsigned short *len) {
+  const struct ip6_hdr *receive = packet;
+  return_if_fail (receive->ip6_hlim > 0) 18;
+  return_if_not (RouteFilter_has(&self->filter, &receive->ip6_dst, true)) 20;
+  unsigned char index;
+  struct FakeHost6 scratch;
+  const struct FakeHost6 *host = cache == NULL ?
+    HostChainTable6_find(
+      self, &receive->ip6_dst, receive->ip6_hlim, &index, &scratch) :
+    HostChainCache6_find(
+      cache, self, &receive->ip6_dst, receive->ip6_hlim, &index, &scratch);
+  return_if_fail (host != NULL) 17;
+  int ret = FakeHost6_reply(host, index, packet, len);
+  if (ret > 0) {
+    ret += 18;
+  }
+  return ret;
+}
+
+
+unsigned int HostChainTable_next_generation (void) {
+  // never 0, so that an empty cache slot matches no table
+  static atomic_uint generation = 0;
+  return atomic_fetch_add(&generation, 1) + 1;
+}
+
+
+size_t HostChainTable_packed_size (const struct HostChainTable *self) {
+  return HostChainArray_packed_size(self->chains, self->nchain) +
+         HostChainArray_packed_size(self->vchains, self->nvchain);
+}
+
+
+int HostChainTable_pack (
+    struct HostChainTable * restrict self, struct Arena * restrict arena) {
+  return_nonzero (HostChainArray_pack(self->chains, self->nchain, arena));
+  return HostChainArray_pack(self->vchains, self->nvchain, arena);
+}
+
+
+int HostChainTable_init_index (struct HostChainTable *self) {
+#ifndef NO_DIR24
+  self->dir.tbl24 = NULL;
+  // not needed with a default route, which would fill all of tbl24
+  if (!self->v6 && !HostChainTable_has_default(self)) {
+    return_nonzero (RouteDir24_init(&self->dir));
+    // from the least specific, the first chain inserted keeps each address
+    for (unsigned int i = self->nchain; i-- > 0;) {
+      // only the last chain of a route is ever chosen
+      continue_if (i + 1 < self->nchain && HostChain_compare(
+        self->chains + i, self->chains + i + 1) == 0);
+      should (RouteDir24_insert(
+          &self->dir, self->chains[i].network, self->chains[i].prefix,
+          i) == 0) otherwise {
+        RouteDir24_destroy(&self->dir);
+        return -1;
+      }
+    }
+  }
+#endif
+  should (RouteFilter_init(
+      &self->filter, (size_t) self->nchain + self->nvchain) == 0) otherwise {
+#ifndef NO_DIR24
+    if (self->dir.tbl24 != NULL) {
+      RouteDir24_destroy(&self->dir);
+    }
+#endif
+    return -1;
+  }
+  for (unsigned int i = 0; i < self->nchain; i++) {
+    RouteFilter_insert(&self->filter, self->chains[i].network,
+                       self->chains[i].prefix, self->v6);
+  }
+  for (unsigned int v = 0; v < self->nvchain; v++) {
+    // the shortest route holding every copy
+    const struct HostChain *vchain = self->vchains + v;
+    struct in6_addr last;
+    memcpy(&last, vchain->network, sizeof(last));
+    inet_shift(self->v6 ? AF_INET6 : AF_INET, &last,
+               (long long) (vchain->ndup - 1) * vchain->dup_step,
+               vchain->dup_prefix);
+    unsigned char prefix = vchain->prefix;
+    while (membcmp(vchain->network, &last, prefix) != 0) {
+      prefix--;
+    }
+    RouteFilter_insert(&self->filter, vchain->network, prefix, self->v6);
+  }
+  return 0;
+}
+
+
+void HostChainTable_destroy (struct HostChainTable *self) {
+  RouteFilter_destroy(&self->filter);
+#ifndef NO_DIR24
+  if (self->dir.tbl24 != NULL) {
+    RouteDir24_destroy(&self->dir);
+  }
+#endif
+  if (!self->mapped) {
+    HostHash_destroy(&self->hash);
+    RouteTrie_destroy(&self->trie);
+  }
+  HostChainArray_destroy_size(self->vchains, self->nvchain);
+  free(self->vchains);
+  HostChainArray_destroy_size(self->chains, self->nchain);
+  free(self->chains);
+}
+
+
+int HostChainTable_init (
+    struct HostChainTable * restrict self, struct HostChain * restrict chains,
+    unsigned int nchain, bool v6) {
+  // move virtual chains out
+  unsigned int nvchain = 0;
+  for (unsigned int i = 0; i < nchain; i++) {
+    if (chains[i].ndup > 1) {
+      nvchain++;
+    }
+  }
+  struct HostChain *vchains = malloc(sizeof(struct HostChain) * (nvchain + 1));
+  return_if_fail (vchains != NULL) -1;
+  unsigned int nreal = 0;
+  nvchain = 0;
+  for (unsigned int i = 0; i < nchain; i++) {
+    if (chains[i].ndup > 1) {
+      vchains[nvchain++] = chains[i];
+    } else {
+      chains[nreal++] = chains[i];
+    }
+  }
+  memset(vchains + nvchain, 0, sizeof(struct HostChain));
+
+  goto_if_fail (RouteTrie_init(&self->trie, v6) == 0) fail_vchains;
+  // caller reserves room for the terminator
+  memset(chains + nreal, 0, sizeof(struct HostChain));
+  HostChainArray_sort(chains);
+
+  for (unsigned int i = 0; i < nreal; i++) {
+    continue_if (i > 0 && HostChain_compare(chains + i - 1, chains + i) == 0);
+    goto_if_fail (RouteTrie_insert(
+      &self->trie, chains[i].network, chains[i].prefix, i) >= 0) fail_trie;
+  }
+  goto_if_fail (RouteTrie_finish(&self->trie) == 0) fail_trie;
+
+  size_t nhost = 0;
+  for (unsigned int i = 0; i < nreal; i++) {
+    nhost += chains[i].len;
+  }
+  goto_if_fail (HostHash_init(&self->hash, nhost, v6) == 0) fail_trie;
+  for (unsigned int i = 0; i < nreal; i++) {
+    for (unsigned int j = 0; j < chains[i].len; j++) {
+      HostHash_insert(&self->hash, HostChain_addr(chains + i, j), i, j);
+    }
+  }
+
+  self->chains = chains;
+  self->nchain = nreal;
+  self->vchains = vchains;
+  self->nvchain = nvchain;
+  self->v6 = v6;
+  goto_if_fail (HostChainTable_init_index(self) == 0) fail_hash;
+  self->generation = HostChainTable_next_generation();
+  self->mapped = false;
+  return 0;
+
+fail_hash:
+  HostHash_destroy(&self->hash);
+fail_trie:
+  RouteTrie_destroy(&self->trie);
+fail_vchains:
+  // give the chains back to the caller
+  memcpy(chains + nreal, vchains, sizeof(struct HostChain) * nvchain);
+  free(vchains);
+  return -1;
+}
@@ -0,0 +1,134 @@
+#ifndef TABLE_H
+#define TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "dir24.h"
+#include "filter.h"
+#include "hash.h"
+#include "trie.h"
+
+// #include "chain.h"
+struct HostChain;
+// #include "cache.h"
+struct HostChainCache;
+// #include "arena.h"
+struct Arena;
+
+
+struct HostChainTable {
+  // sorted, null terminated
+  struct HostChain *chains;
+  unsigned int nchain;
+  // chains duplicated by -E, each standing for many copies
+  struct HostChain *vchains;
+  unsigned int nvchain;
+  bool v6;
+  // route -> index of the first chain with that route
+  struct RouteTrie trie;
+#ifndef NO_DIR24
+  // v4 only, tbl24 == NULL otherwise; address -> index of the last chain of
+  // the least specific route holding it
+  struct RouteDir24 dir;
+#endif
+  // host address -> index of chain and position in chain; virtual chains are
+  // few and scanned directly
+  struct HostHash hash;
+  // routes of all chains and copies, rejects most addresses outside them
+  struct RouteFilter filter;
+  // unique among all tables ever built
+  unsigned int generation;
+  // trie and hash live in a compiled table image
+  bool mapped;
+};
+
+// lookup result of an address that holds for every TTL
+struct HostChainRoute {
+  // the only chain holding the address, NULL if none
+  const struct HostChain *chain;
+  unsigned int dup;
+  unsigned char pos;
+  // the last chain of the least specific route, NULL if none
+  const struct HostChain *last;
+  unsigned int last_dup;
+};
+
+
+// lookups specialized for either version, and dispatching on self->v6
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2), access(write_only, 4),
+               access(write_only, 5)))
+void *HostChainTable4_find (
+  const struct HostChainTable * restrict self, const void * restrict addr,
+  unsigned char ttl, unsigned char *index, void * restrict scratch);
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2), access(write_only, 4),
+               access(write_only, 5)))
+void *HostChainTable6_find (
+  const struct HostChainTable * restrict self, const void * restrict addr,
+  unsigned char ttl, unsigned char *index, void * restrict scratch);
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2), access(write_only, 4),
+               access(write_only, 5)))
+void *HostChainTable_find (
+  const struct HostChainTable * restrict self, const void * restrict addr,
+  unsigned char ttl, unsigned char *index, void * restrict scratch);
+// returns 1 if several chains hold addr, so which one replies depends on TTL
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2), access(write_only, 3)))
+int HostChainTable4_resolve (
+  const struct HostChainTable * restrict self, const void * restrict addr,
+  struct HostChainRoute * restrict route);
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2), access(write_only, 3)))
+int HostChainTable6_resolve (
+  const struct HostChainTable * restrict self, const void * restrict addr,
+  struct HostChainRoute * restrict route);
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(read_only, 2), access(write_only, 3)))
+int HostChainTable_resolve (
+  const struct HostChainTable * restrict self, const void * restrict addr,
+  struct HostChainRoute * restrict route);
+// host replying at ttl on a resolved route
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(write_only, 3), access(write_only, 4)))
+void *HostChainTable4_route (
+  const struct HostChainRoute * restrict route, unsigned char ttl,
+  unsigned char *index, void * restrict scratch);
+__attribute__((nonnull, warn_unused_result, access(read_only, 1),
+               access(write_only, 3), access(write_only, 4)))
+void *HostChainTable6_route (
+  const struct HostChainRoute * restrict route, unsigned char ttl,
+  unsigned char *index, void * restrict scratch);
+// error 17 if no host replies, 20 if no route holds the destination at all
+__attribute__((nonnull(1, 3, 4), access(read_only, 1)))
+int HostChainTable4_reply (
+  const struct HostChainTable * restrict self,
+  struct HostChainCache *cache, void *packet, unsigned short *len);
+__attribute__((nonnull(1, 3, 4), access(read_only, 1)))
+int HostChainTable6_reply (
+  const struct HostChainTable * restrict self,
+  struct HostChainCache *cache, void *packet, unsigned short *len);
+__attribute__((warn_unused_result))
+unsigned int HostChainTable_next_generation (void);
+// room taken by the hosts of all chains in an arena
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+size_t HostChainTable_packed_size (const struct HostChainTable *self);
+// move the hosts into arena in lookup order, so that neighbouring routes
+// share cache lines and pages
+__attribute__((nonnull, warn_unused_result))
+int HostChainTable_pack (
+  struct HostChainTable * restrict self, struct Arena * restrict arena);
+// builds the lookup structures not stored in a compiled image
+__attribute__((nonnull, warn_unused_result))
+int HostChainTable_init_index (struct HostChainTable *self);
+__attribute__((nonnull))
+void HostChainTable_destroy (struct HostChainTable *self);
+__attribute__((nonnull, warn_unused_result))
+int HostChainTable_init (
+  struct HostChainTable * restrict self, struct HostChain * restrict chains,
+  unsigned int nchain, bool v6);
+
+
+#endif /* TABLE_H */
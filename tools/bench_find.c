@@ -0,0 +1,104 @@
+// the engines are static, so time them where they are defined
+#include "chain.c"
+
+#include <time.h>
+
+
+// scans per run, and runs per measurement
+#define BENCH_NQUERY 1000000
+#define BENCH_NRUN 3
+
+
+struct BenchEngine {
+  const char *name;
+  int (*find4) (const struct in_addr *addrs, unsigned int n, in_addr_t a);
+  int (*find6) (
+    const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a);
+};
+
+
+static double bench_now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// best ns per scan of addrs for a missing key, as a packet to the same
+// route but to no host would cost
+__attribute__((noinline))
+static double bench_run (
+    const struct BenchEngine *engine, const void *addrs, unsigned int n,
+    const void *key, bool v6) {
+  in_addr_t a;
+  memcpy(&a, key, sizeof(a));
+  double best = 0;
+  for (int run = 0; run < BENCH_NRUN; run++) {
+    volatile int sink = 0;
+    double start = bench_now();
+    for (unsigned int i = 0; i < BENCH_NQUERY; i++) {
+      sink += v6 ? engine->find6(addrs, n, key) : engine->find4(addrs, n, a);
+    }
+    double ns = (bench_now() - start) / BENCH_NQUERY * 1e9;
+    if (run == 0 || ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+
+int main (void) {
+  // the scalar one is the loop HostChain_find used before the engines
+  struct BenchEngine engines[4];
+  unsigned int nengine = 0;
+  engines[nengine++] = (struct BenchEngine) {
+    "scalar", HostChain_find4_generic, HostChain_find6_generic};
+#if defined __x86_64__ || defined __i386__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    engines[nengine++] = (struct BenchEngine) {
+      "SSE2", HostChain_find4_sse2, HostChain_find6_sse2};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    engines[nengine++] = (struct BenchEngine) {
+      "AVX2", HostChain_find4_avx2, HostChain_find6_avx2};
+  }
+#elif defined __ARM_NEON && defined USE_NEON
+  engines[nengine++] = (struct BenchEngine) {
+    "NEON", HostChain_find4_neon, HostChain_find6_neon};
+#endif
+
+  static const unsigned int lens[] = {8, 32, 255};
+  printf("full scan of a chain on a miss, in the same /24 or /64, ns\n\n"
+         "          ");
+  for (unsigned int i = 0; i < nengine; i++) {
+    printf(" %7s", engines[i].name);
+  }
+  printf("\n");
+  for (int v6 = 0; v6 <= 1; v6++) {
+    for (unsigned int j = 0; j < arraysize(lens); j++) {
+      const unsigned int n = lens[j];
+      struct in6_addr addrs[lens[arraysize(lens) - 1] + 1];
+      memset(addrs, 0, sizeof(addrs));
+      // hosts 1 to n, and host n + 1 as the key
+      for (unsigned int i = 0; i <= n; i++) {
+        if (v6) {
+          addrs[i].s6_addr[0] = 0x20;
+          addrs[i].s6_addr[14] = (i + 1) >> 8;
+          addrs[i].s6_addr[15] = i + 1;
+        } else {
+          ((struct in_addr *) addrs)[i].s_addr = htonl(0x0a000000 + i + 1);
+        }
+      }
+      const void *key = v6 ? (const void *) (addrs + n) :
+        (const void *) ((struct in_addr *) addrs + n);
+      printf("v%d len %3u", v6 ? 6 : 4, n);
+      for (unsigned int i = 0; i < nengine; i++) {
+        printf(" %7.1f", bench_run(engines + i, addrs, n, key, v6));
+      }
+      printf("\n");
+    }
+  }
+  return EXIT_SUCCESS;
+}
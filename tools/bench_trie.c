@@ -0,0 +1,154 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+
+#include "macro.h"
+#include "arena.h"
+#include "host.h"
+#include "chain.h"
+#include "trie.h"
+#include "table.h"
+
+
+// lookups per run, and runs per measurement
+#define BENCH_NQUERY 1000000
+#define BENCH_NRUN 3
+
+
+static uint64_t bench_state = 88172645463325252ULL;
+
+static uint32_t bench_random (void) {
+  bench_state ^= bench_state << 13;
+  bench_state ^= bench_state >> 7;
+  bench_state ^= bench_state << 17;
+  return bench_state >> 32;
+}
+
+
+static double bench_now (void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+// address i of the 3 hosts in the route of chain k, a /24 or a /64
+static void bench_addr (
+    unsigned char *addr, unsigned int k, unsigned int i, bool v6) {
+  k++;
+  if (v6) {
+    memset(addr, 0, sizeof(struct in6_addr));
+    addr[0] = 0x30;
+    addr[4] = k >> 24;
+    addr[5] = k >> 16;
+    addr[6] = k >> 8;
+    addr[7] = k;
+    addr[15] = i;
+  } else {
+    addr[0] = 10 + (k >> 16);
+    addr[1] = k >> 8;
+    addr[2] = k;
+    addr[3] = i;
+  }
+}
+
+
+// n chains of 3 hosts, each on a route of its own
+static int bench_table (
+    struct HostChainTable * restrict table, struct Arena * restrict arena,
+    unsigned int n, bool v6) {
+  struct HostChain *chains = malloc(sizeof(struct HostChain) * (n + 1));
+  return_if_fail (chains != NULL) -1;
+  const int af = v6 ? AF_INET6 : AF_INET;
+  for (unsigned int k = 0; k < n; k++) {
+    char s_addr[4][INET6_ADDRSTRLEN];
+    for (unsigned int i = 0; i < arraysize(s_addr); i++) {
+      unsigned char addr[sizeof(struct in6_addr)];
+      bench_addr(addr, k, i == 0 ? 0 : 4 - i, v6);
+      inet_ntop(af, addr, s_addr[i], sizeof(s_addr[i]));
+    }
+    char s[256];
+    snprintf(s, sizeof(s), "route=%s/%d,%s-%s", s_addr[0], v6 ? 64 : 24,
+             s_addr[1], s_addr[3]);
+    return_nonzero (HostChain_init(chains + k, s, v6));
+  }
+  return_nonzero (HostChainTable_init(table, chains, n, v6));
+  // hosts in lookup order, as rdnstun does
+  Arena_init(arena, HostChainTable_packed_size(table), false);
+  return_if_fail (Arena_reserve(
+    arena, HostChainTable_packed_size(table)) != NULL) -1;
+  return HostChainTable_pack(table, arena);
+}
+
+
+// best ns per lookup of queries, through the trie or the whole table
+static double bench_run (
+    const struct HostChainTable *table,
+    const unsigned char (*queries)[sizeof(struct in6_addr)], bool trie) {
+  double best = 0;
+  for (int run = 0; run < BENCH_NRUN; run++) {
+    volatile uintptr_t sink = 0;
+    union {
+      struct FakeHost host;
+      struct FakeHost6 host6;
+    } scratch;
+    unsigned char index;
+    double start = bench_now();
+    for (unsigned int i = 0; i < BENCH_NQUERY; i++) {
+      sink += trie ? RouteTrie_lookup(&table->trie, queries[i]) :
+        (uintptr_t) HostChainTable_find(table, queries[i], 64, &index,
+                                        &scratch);
+    }
+    double ns = (bench_now() - start) / BENCH_NQUERY * 1e9;
+    if (run == 0 || ns < best) {
+      best = ns;
+    }
+  }
+  return best;
+}
+
+
+int main (int argc, char *argv[]) {
+  unsigned int max_chain = argc > 1 ? strtoul(argv[1], NULL, 0) : 1000000;
+  unsigned char (*queries)[sizeof(struct in6_addr)] =
+    malloc(sizeof(*queries) * BENCH_NQUERY);
+  should (queries != NULL) otherwise {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+
+  static const unsigned int nchains[] = {10, 1000, 100000, 1000000};
+  printf("lookups of random addresses, half of them hosts, in random "
+         "chains\n\n"
+         "      chains    trie    find\n");
+  for (int v6 = 0; v6 <= 1; v6++) {
+    for (unsigned int j = 0; j < arraysize(nchains); j++) {
+      const unsigned int n = nchains[j];
+      break_if (n > max_chain);
+      struct HostChainTable table;
+      struct Arena arena;
+      should (bench_table(&table, &arena, n, v6) == 0) otherwise {
+        fprintf(stderr, "error: cannot build a table of %u chains\n", n);
+        return EXIT_FAILURE;
+      }
+      for (unsigned int i = 0; i < BENCH_NQUERY; i++) {
+        unsigned int k = bench_random() % n;
+        bench_addr(queries[i], k,
+                   bench_random() % 2 ? 1 + bench_random() % 3 :
+                   4 + bench_random() % 252, v6);
+      }
+      printf("v%d %9u %5.0f ns %5.0f ns\n", v6 ? 6 : 4, n,
+             bench_run(&table, queries, true),
+             bench_run(&table, queries, false));
+      HostChainTable_destroy(&table);
+      Arena_destroy(&arena);
+    }
+  }
+
+  free(queries);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,102 @@
+// the engines are static, so check them where they are defined
+#include "inet.c"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+
+// random buffers, the longest random one, and the all-ones one that comes
+// closest to overflowing the lanes
+#define CHECK_NBUF 200000
+#define CHECK_MAXLEN 9000
+#define CHECK_ONES_LEN (4 * INET_CKSUM_CHUNK * 32 + 7)
+
+
+struct CheckEngine {
+  const char *name;
+  uint32_t (*continue_) (uint32_t sum, const void *buf, size_t count);
+};
+
+
+static uint64_t check_state = 88172645463325252ULL;
+
+static uint32_t check_random (void) {
+  check_state ^= check_state << 13;
+  check_state ^= check_state >> 7;
+  check_state ^= check_state << 17;
+  return check_state >> 32;
+}
+
+
+// number of engines that disagree with the scalar loop
+static unsigned int check_buffer (
+    const struct CheckEngine *engines, unsigned int nengine,
+    uint32_t sum, const unsigned char *buf, size_t count) {
+  unsigned int nbad = 0;
+  uint32_t expected = inet_cksum_continue_scalar(sum, buf, count);
+  for (unsigned int i = 0; i < nengine; i++) {
+    uint32_t got = engines[i].continue_(sum, buf, count);
+    continue_if (got == expected);
+    fprintf(stderr, "%s: sum %#x, %zu bytes at %p: %#x, expected %#x\n",
+            engines[i].name, sum, count, (const void *) buf, got, expected);
+    nbad++;
+  }
+  return nbad;
+}
+
+
+int main (void) {
+  struct CheckEngine engines[3];
+  unsigned int nengine = 0;
+  engines[nengine++] = (struct CheckEngine) {
+    "generic", inet_cksum_continue_generic};
+#if defined __x86_64__ || defined __i386__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    engines[nengine++] = (struct CheckEngine) {
+      "sse2", inet_cksum_continue_sse2};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    engines[nengine++] = (struct CheckEngine) {
+      "avx2", inet_cksum_continue_avx2};
+  }
+#elif defined __ARM_NEON && defined USE_NEON
+  engines[nengine++] = (struct CheckEngine) {
+    "neon", inet_cksum_continue_neon};
+#endif
+
+  unsigned char *buf = malloc(CHECK_ONES_LEN + 16);
+  should (buf != NULL) otherwise {
+    perror("malloc");
+    return EXIT_FAILURE;
+  }
+
+  unsigned int nbad = 0;
+  for (unsigned int i = 0; i < CHECK_NBUF; i++) {
+    // refill now and then, and start at any alignment
+    if (i % 16 == 0) {
+      for (size_t j = 0; j < CHECK_MAXLEN + 16; j += 4) {
+        uint32_t x = check_random();
+        memcpy(buf + j, &x, sizeof(x));
+      }
+    }
+    size_t offset = check_random() % 16;
+    // mostly packet sizes, sometimes up to a jumbo frame
+    size_t count = check_random() % (i % 4 == 0 ? CHECK_MAXLEN : 1500);
+    uint32_t sum = i % 2 == 0 ? check_random() : check_random() % 0x10000;
+    nbad += check_buffer(engines, nengine, sum, buf + offset, count);
+  }
+  memset(buf, 0xff, CHECK_ONES_LEN + 16);
+  for (size_t offset = 0; offset < 16; offset++) {
+    nbad += check_buffer(
+      engines, nengine, 0xffffffff, buf + offset, CHECK_ONES_LEN - offset);
+  }
+  free(buf);
+
+  for (unsigned int i = 0; i < nengine; i++) {
+    printf("%s ", engines[i].name);
+  }
+  printf("against scalar, %u buffers: %u mismatches\n", CHECK_NBUF + 16, nbad);
+  return nbad == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,120 @@
+// the engines are static, so check them where they are defined
+#include "chain.c"
+
+
+// chains up to the longest TTL, each with a few layouts
+#define CHECK_MAXLEN 255
+#define CHECK_NROUND 4
+
+
+struct CheckEngine {
+  const char *name;
+  int (*find4) (const struct in_addr *addrs, unsigned int n, in_addr_t a);
+  int (*find6) (
+    const struct in6_addr *addrs, unsigned int n, const struct in6_addr *a);
+};
+
+
+static uint64_t check_state = 88172645463325252ULL;
+
+static uint32_t check_random (void) {
+  check_state ^= check_state << 13;
+  check_state ^= check_state >> 7;
+  check_state ^= check_state << 17;
+  return check_state >> 32;
+}
+
+
+// number of engines that disagree with the scalar loop; addrs is allocated
+// to exactly n addresses, so that ASan catches reads past the chain
+static unsigned int check_chain (
+    const struct CheckEngine *engines, unsigned int nengine,
+    const void *addrs, unsigned int n, const void *key, bool v6) {
+  unsigned int nbad = 0;
+  in_addr_t a;
+  memcpy(&a, key, sizeof(a));
+  int expected = v6 ? HostChain_find6_generic(addrs, n, key) :
+    HostChain_find4_generic(addrs, n, a);
+  for (unsigned int i = 0; i < nengine; i++) {
+    int got = v6 ? engines[i].find6(addrs, n, key) :
+      engines[i].find4(addrs, n, a);
+    continue_if (got == expected);
+    fprintf(stderr, "%s: v%d, %u addresses: %d, expected %d\n",
+            engines[i].name, v6 ? 6 : 4, n, got, expected);
+    nbad++;
+  }
+  return nbad;
+}
+
+
+// addresses that differ from key in one byte, often in one half only, so
+// that engines comparing halves or bytes separately are caught out
+static void check_fill (
+    unsigned char *addrs, unsigned int n, const unsigned char *key,
+    size_t size) {
+  for (unsigned int i = 0; i < n; i++) {
+    unsigned char *addr = addrs + size * i;
+    memcpy(addr, key, size);
+    addr[check_random() % size] ^= 1 + check_random() % 255;
+  }
+}
+
+
+int main (void) {
+  struct CheckEngine engines[3];
+  unsigned int nengine = 0;
+#if defined __x86_64__ || defined __i386__
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse2")) {
+    engines[nengine++] = (struct CheckEngine) {
+      "sse2", HostChain_find4_sse2, HostChain_find6_sse2};
+  }
+  if (__builtin_cpu_supports("avx2")) {
+    engines[nengine++] = (struct CheckEngine) {
+      "avx2", HostChain_find4_avx2, HostChain_find6_avx2};
+  }
+#elif defined __ARM_NEON && defined USE_NEON
+  engines[nengine++] = (struct CheckEngine) {
+    "neon", HostChain_find4_neon, HostChain_find6_neon};
+#endif
+
+  unsigned int nbad = 0;
+  unsigned long nchain = 0;
+  for (int v6 = 0; v6 <= 1; v6++) {
+    const size_t size = v6 ? sizeof(struct in6_addr) : sizeof(struct in_addr);
+    for (unsigned int n = 1; n <= CHECK_MAXLEN; n++) {
+      unsigned char *addrs = malloc(size * n);
+      should (addrs != NULL) otherwise {
+        perror("malloc");
+        return EXIT_FAILURE;
+      }
+      for (unsigned int round = 0; round < CHECK_NROUND; round++) {
+        unsigned char key[sizeof(struct in6_addr)];
+        for (size_t j = 0; j < size; j++) {
+          key[j] = check_random();
+        }
+        // a miss, then a hit at each position, sometimes seen again later
+        check_fill(addrs, n, key, size);
+        nbad += check_chain(engines, nengine, addrs, n, key, v6);
+        nchain++;
+        for (unsigned int i = 0; i < n; i++) {
+          check_fill(addrs, n, key, size);
+          memcpy(addrs + size * i, key, size);
+          if (round % 2 != 0 && i + 1 < n) {
+            unsigned int later = i + 1 + check_random() % (n - i - 1);
+            memcpy(addrs + size * later, key, size);
+          }
+          nbad += check_chain(engines, nengine, addrs, n, key, v6);
+          nchain++;
+        }
+      }
+      free(addrs);
+    }
+  }
+
+  for (unsigned int i = 0; i < nengine; i++) {
+    printf("%s ", engines[i].name);
+  }
+  printf("against scalar, %lu chains: %u mismatches\n", nchain, nbad);
+  return nbad == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,135 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <net/if.h>
+
+#include "macro.h"
+#include "latency.h"
+#include "stats.h"
+#include "rdnstun.h"
+
+
+static void usage (const char *progname) {
+  fprintf(stderr, "Usage: %s [OPTIONS]... [<iface>]\n", progname);
+  fputs(
+"\n"
+"Print packet counters of a running " RDNSTUN_NAME " on <iface>, default: "
+RDNSTUN_IFACE_NAME "\n"
+"\n"
+"  -t  print counters of each thread\n"
+"  -l  print percentiles of reply latency in ns, merged unless -t\n"
+"  -h  prints this help text\n", stderr);
+}
+
+
+int main (int argc, char *argv[]) {
+  bool per_thread = false;
+  bool latency = false;
+  for (int option; (option = getopt(argc, argv, "tlh")) != -1;) {
+    switch (option) {
+      case 't':
+        per_thread = true;
+        break;
+      case 'l':
+        latency = true;
+        break;
+      case 'h':
+        usage(argv[0]);
+        return EXIT_SUCCESS;
+      default:
+        return EXIT_FAILURE;
+    }
+  }
+  should (optind >= argc - 1) otherwise {
+    fprintf(stderr, "error: too many positional options\n");
+    return EXIT_FAILURE;
+  }
+  const char *if_name = optind < argc ? argv[optind] : RDNSTUN_IFACE_NAME;
+
+  char name[NAME_MAX];
+  snprintf(name, sizeof(name), RDNSTUN_STATS_NAME, if_name);
+  struct StatsSegment segment;
+  should (StatsSegment_open(&segment, name) == 0) otherwise {
+    fprintf(stderr, "error: cannot open /dev/shm%s: %s\n",
+            name, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  unsigned int nthread = segment.header->nthread;
+  uint64_t counters[nthread][STATS_MAX];
+  uint64_t total[STATS_MAX] = {0};
+  int ret = EXIT_SUCCESS;
+  for (unsigned int i = 0; i < nthread; i++) {
+    should (StatsThread_read(segment.threads + i, counters[i]) == 0) otherwise {
+      fprintf(stderr, "error: counters of thread %u keep changing\n", i);
+      memset(counters[i], 0, sizeof(counters[i]));
+      ret = EXIT_FAILURE;
+    }
+    for (unsigned int j = 0; j < STATS_MAX; j++) {
+      total[j] += counters[i][j];
+    }
+  }
+
+  if (per_thread) {
+    printf("%-24s", "fd");
+    for (unsigned int i = 0; i < nthread; i++) {
+      printf(" %12d", segment.threads[i].tunfd);
+    }
+    puts("");
+  }
+  for (unsigned int j = 0; j < STATS_MAX; j++) {
+    printf("%-24s", StatsCounter_names[j]);
+    if (per_thread) {
+      for (unsigned int i = 0; i < nthread; i++) {
+        printf(" %12llu", (unsigned long long) counters[i][j]);
+      }
+    } else {
+      printf(" %llu", (unsigned long long) total[j]);
+    }
+    puts("");
+  }
+
+  if (latency) {
+    static const double percentiles[] = {50, 90, 99, 99.9, 99.99, 100};
+    struct LatencyHist *hists = per_thread ? NULL : calloc(1, sizeof(*hists));
+    should (per_thread || hists != NULL) otherwise {
+      perror("calloc");
+      StatsSegment_destroy(&segment);
+      return EXIT_FAILURE;
+    }
+    if (hists != NULL) {
+      for (unsigned int i = 0; i < nthread; i++) {
+        LatencyHist_merge(hists, &segment.threads[i].latency);
+      }
+    }
+    unsigned int ncolumn = per_thread ? nthread : 1;
+
+    puts("");
+    for (unsigned int j = 0; j <= arraysize(percentiles); j++) {
+      if (j == 0) {
+        printf("%-24s", "latency_count");
+      } else {
+        char label[24];
+        snprintf(label, sizeof(label), "latency_p%g", percentiles[j - 1]);
+        printf("%-24s", label);
+      }
+      for (unsigned int i = 0; i < ncolumn; i++) {
+        const struct LatencyHist *hist =
+          hists != NULL ? hists : &segment.threads[i].latency;
+        unsigned long long value = j == 0 ? LatencyHist_total(hist) :
+          LatencyHist_percentile(hist, percentiles[j - 1]) *
+          segment.header->ns_per_tick;
+        printf(per_thread ? " %12llu" : " %llu", value);
+      }
+      puts("");
+    }
+    free(hists);
+  }
+
+  StatsSegment_destroy(&segment);
+  return ret;
+}
@@ -0,0 +1,248 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+#include "macro.h"
+#include "inet.h"
+#include "trie.h"
+
+
+static inline unsigned int addr_bit (const void *addr, unsigned int i) {
+  return (((const unsigned char *) addr)[i / 8] >> (7 - i % 8)) & 1;
+}
+
+
+// number of leading bits shared by a and b, at most n
+static unsigned int addr_common (
+    const void *a, const void *b, unsigned int n) {
+  const unsigned char *x = a;
+  const unsigned char *y = b;
+  unsigned int i;
+  for (i = 0; i < n / 8 && x[i] == y[i]; i++) { }
+  return_if (i * 8 >= n) n;
+  unsigned char diff = x[i] ^ y[i];
+  return_if (diff == 0) n;
+  return min(i * 8 + __builtin_clz(diff) - (sizeof(int) - 1) * 8, n);
+}
+
+
+static inline unsigned int addr_bits (
+    const void *addr, unsigned int i, unsigned int n) {
+  const unsigned char *a = addr;
+  uint_fast32_t bits = 0;
+  for (unsigned int j = i / 8; j <= (i + n - 1) / 8; j++) {
+    bits = (bits << 8) | a[j];
+  }
+  bits >>= 7 - (i + n - 1) % 8;
+  return bits & ((1u << n) - 1);
+}
+
+
+unsigned int RouteTrie_lookup (
+    const struct RouteTrie * restrict self, const void * restrict addr) {
+  // descend by the bits of addr only, skipped bits are verified afterwards
+  unsigned int best;
+  unsigned int node;
+  if (self->stride > 0) {
+    const struct RouteTrieJump *j =
+      self->jump + addr_bits(addr, self->jump_prefix, self->stride);
+    best = j->best;
+    node = j->node;
+  } else {
+    best = self->nodes[0].entry ? 0 : ROUTETRIE_NONE;
+    node = self->nodes[0].child[addr_bit(addr, 0)];
+  }
+  // root is never a child
+  while (node != 0) {
+    const struct RouteTrieNode *n = self->nodes + node;
+    if (n->entry) {
+      best = node;
+    }
+    break_if (n->prefix >= self->width);
+    node = n->child[addr_bit(addr, n->prefix)];
+  }
+
+  // every ancestor of a matching entry matches too
+  for (; best != ROUTETRIE_NONE; best = self->entries[best].parent) {
+    const struct RouteTrieEntry *e = self->entries + best;
+    unsigned char prefix = self->nodes[best].prefix;
+    break_if (prefix == 0 || membcmp(&e->key, addr, prefix) == 0);
+  }
+  return best;
+}
+
+
+static unsigned int RouteTrie_new_node (
+    struct RouteTrie * restrict self, const void * restrict key,
+    unsigned char prefix, bool entry, unsigned int value) {
+  if (self->nnode >= self->cap) {
+    struct RouteTrieNode *nodes = realloc(
+      self->nodes, sizeof(struct RouteTrieNode) * self->cap * 2);
+    return_if_fail (nodes != NULL) ROUTETRIE_NONE;
+    self->nodes = nodes;
+    struct RouteTrieEntry *entries = realloc(
+      self->entries, sizeof(struct RouteTrieEntry) * self->cap * 2);
+    return_if_fail (entries != NULL) ROUTETRIE_NONE;
+    self->entries = entries;
+    self->cap *= 2;
+  }
+
+  struct RouteTrieNode *n = self->nodes + self->nnode;
+  n->prefix = prefix;
+  n->entry = entry;
+  n->child[0] = 0;
+  n->child[1] = 0;
+
+  struct RouteTrieEntry *e = self->entries + self->nnode;
+  memset(&e->key, 0, sizeof(e->key));
+  memcpy(&e->key, key, (prefix + 7) / 8);
+  if (prefix % 8 != 0) {
+    e->key.s6_addr[prefix / 8] &= (unsigned char) -1 << (8 - prefix % 8);
+  }
+  e->parent = ROUTETRIE_NONE;
+  e->value = value;
+  return self->nnode++;
+}
+
+
+int RouteTrie_insert (
+    struct RouteTrie * restrict self, const void * restrict key,
+    unsigned char prefix, unsigned int value) {
+  unsigned int node = 0;
+  while (1) {
+    // key always shares the leading n->prefix bits with node
+    struct RouteTrieNode *n = self->nodes + node;
+    if (n->prefix == prefix) {
+      return_if (n->entry) 1;
+      n->entry = true;
+      self->entries[node].value = value;
+      return 0;
+    }
+
+    unsigned int b = addr_bit(key, n->prefix);
+    unsigned int c = n->child[b];
+    if (c == 0) {
+      unsigned int leaf = RouteTrie_new_node(self, key, prefix, true, value);
+      return_if_fail (leaf != ROUTETRIE_NONE) -1;
+      self->nodes[node].child[b] = leaf;
+      return 0;
+    }
+
+    unsigned char child_prefix = self->nodes[c].prefix;
+    unsigned int common = addr_common(
+      key, &self->entries[c].key, min(prefix, child_prefix));
+    if (common == child_prefix) {
+      node = c;
+      continue;
+    }
+
+    // split the edge to child
+    unsigned int mid = RouteTrie_new_node(
+      self, key, common, common == prefix, value);
+    return_if_fail (mid != ROUTETRIE_NONE) -1;
+    self->nodes[mid].child[addr_bit(&self->entries[c].key, common)] = c;
+    if (common != prefix) {
+      unsigned int leaf = RouteTrie_new_node(self, key, prefix, true, value);
+      return_if_fail (leaf != ROUTETRIE_NONE) -1;
+      self->nodes[mid].child[addr_bit(key, common)] = leaf;
+    }
+    self->nodes[node].child[b] = mid;
+    return 0;
+  }
+}
+
+
+static void RouteTrie_link (
+    struct RouteTrie *self, unsigned int node, unsigned int parent) {
+  const struct RouteTrieNode *n = self->nodes + node;
+  self->entries[node].parent = parent;
+  if (n->entry) {
+    parent = node;
+  }
+  for (unsigned int i = 0; i < 2; i++) {
+    if (n->child[i] != 0) {
+      RouteTrie_link(self, n->child[i], parent);
+    }
+  }
+}
+
+
+int RouteTrie_finish (struct RouteTrie *self) {
+  RouteTrie_link(self, 0, ROUTETRIE_NONE);
+
+  free(self->jump);
+  self->jump = NULL;
+  self->stride = 0;
+
+  // skip the common prefix of all routes
+  unsigned int base = 0;
+  while (1) {
+    const struct RouteTrieNode *n = self->nodes + base;
+    break_if (n->entry || (n->child[0] == 0) == (n->child[1] == 0));
+    base = n->child[0] | n->child[1];
+  }
+  const struct RouteTrieNode *base_node = self->nodes + base;
+  return_if (base_node->child[0] == 0 && base_node->child[1] == 0) 0;
+
+  // about one slot per node
+  unsigned int stride = 0;
+  while (stride < ROUTETRIE_MAX_STRIDE &&
+         base_node->prefix + stride < self->width &&
+         (2u << stride) <= self->nnode) {
+    stride++;
+  }
+  return_if (stride == 0) 0;
+  self->jump = malloc(sizeof(struct RouteTrieJump) << stride);
+  return_if_fail (self->jump != NULL) -1;
+
+  for (unsigned int i = 0; i < 1u << stride; i++) {
+    // left aligned bits to walk, consumed at base_node->prefix
+    unsigned char key[sizeof(struct in6_addr)] = {0};
+    for (unsigned int b = 0; b < stride; b++) {
+      unsigned int pos = base_node->prefix + b;
+      key[pos / 8] |= ((i >> (stride - 1 - b)) & 1) << (7 - pos % 8);
+    }
+
+    unsigned int best = ROUTETRIE_NONE;
+    unsigned int node = base;
+    do {
+      const struct RouteTrieNode *n = self->nodes + node;
+      break_if (n->prefix >= base_node->prefix + stride);
+      if (n->entry) {
+        best = node;
+      }
+      node = n->child[addr_bit(key, n->prefix)];
+    } while (node != 0);
+    self->jump[i] = (struct RouteTrieJump) {.node = node, .best = best};
+  }
+  self->jump_prefix = base_node->prefix;
+  self->stride = stride;
+  return 0;
+}
+
+
+void RouteTrie_destroy (struct RouteTrie *self) {
+  free(self->jump);
+  free(self->nodes);
+  free(self->entries);
+}
+
+
+int RouteTrie_init (struct RouteTrie *self, bool v6) {
+  self->cap = 16;
+  self->jump = NULL;
+  self->stride = 0;
+  self->nodes = malloc(sizeof(struct RouteTrieNode) * self->cap);
+  self->entries = malloc(sizeof(struct RouteTrieEntry) * self->cap);
+  should (self->nodes != NULL && self->entries != NULL) otherwise {
+    RouteTrie_destroy(self);
+    return -1;
+  }
+  self->nnode = 0;
+  self->width = v6 ? 128 : 32;
+  static const struct in6_addr any = IN6ADDR_ANY_INIT;
+  RouteTrie_new_node(self, &any, 0, false, 0);
+  return 0;
+}
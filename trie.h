@@ -0,0 +1,75 @@
+#ifndef TRIE_H
+#define TRIE_H
+
+#include <stdbool.h>
+#include <netinet/in.h>
+
+
+#define ROUTETRIE_NONE ((unsigned int) -1)
+#define ROUTETRIE_MAX_STRIDE 16
+
+
+// touched on every step of the descent, keep it small
+struct RouteTrieNode {
+  unsigned char prefix;
+  bool entry;
+  // 0 if no child, root is never a child
+  unsigned int child[2];
+};
+
+// only touched for entry candidates
+struct RouteTrieEntry {
+  struct in6_addr key;
+  // nearest entry ancestor
+  unsigned int parent;
+  unsigned int value;
+};
+
+struct RouteTrieJump {
+  // node to continue the descent from, 0 if none
+  unsigned int node;
+  // deepest entry candidate above node
+  unsigned int best;
+};
+
+// path-compressed binary trie for longest prefix match
+struct RouteTrie {
+  struct RouteTrieNode *nodes;
+  struct RouteTrieEntry *entries;
+  unsigned int nnode;
+  unsigned int cap;
+  unsigned char width;
+  // direct pointing on the bits following the first branch
+  unsigned char jump_prefix;
+  unsigned char stride;
+  struct RouteTrieJump *jump;
+};
+
+
+__attribute__((nonnull, pure, warn_unused_result,
+               access(read_only, 1), access(read_only, 2)))
+unsigned int RouteTrie_lookup (
+  const struct RouteTrie * restrict self, const void * restrict addr);
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+static inline unsigned int RouteTrie_parent (
+    const struct RouteTrie *self, unsigned int node) {
+  return self->entries[node].parent;
+}
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+static inline unsigned int RouteTrie_value (
+    const struct RouteTrie *self, unsigned int node) {
+  return self->entries[node].value;
+}
+__attribute__((nonnull, warn_unused_result, access(read_only, 2)))
+int RouteTrie_insert (
+  struct RouteTrie * restrict self, const void * restrict key,
+  unsigned char prefix, unsigned int value);
+__attribute__((nonnull, warn_unused_result))
+int RouteTrie_finish (struct RouteTrie *self);
+__attribute__((nonnull))
+void RouteTrie_destroy (struct RouteTrie *self);
+__attribute__((nonnull, warn_unused_result))
+int RouteTrie_init (struct RouteTrie *self, bool v6);
+
+
+#endif /* TRIE_H */
@@ -0,0 +1,207 @@
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "macro.h"
+#include "uring.h"
+
+
+static int io_uring_setup (unsigned int entries, struct io_uring_params *p) {
+  return syscall(__NR_io_uring_setup, entries, p);
+}
+
+
+static int io_uring_enter (
+    int fd, unsigned int to_submit, unsigned int min_complete,
+    unsigned int flags) {
+  return syscall(
+    __NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+
+static int io_uring_register (
+    int fd, unsigned int opcode, void *arg, unsigned int nr_args) {
+  return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+
+struct io_uring_sqe *URing_get_sqe (struct URing *self) {
+  unsigned int head = __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+  return_if_fail (self->sq_local_tail - head < self->sq_entries) NULL;
+  struct io_uring_sqe *sqe =
+    &self->sqes[self->sq_local_tail & self->sq_mask];
+  self->sq_local_tail++;
+  memset(sqe, 0, sizeof(*sqe));
+  return sqe;
+}
+
+
+int URing_submit_and_wait (struct URing *self, unsigned int wait_nr) {
+  unsigned int tail = *self->sq_tail;
+  for (; tail != self->sq_local_tail; tail++) {
+    self->sq_array[tail & self->sq_mask] = tail & self->sq_mask;
+  }
+  __atomic_store_n(self->sq_tail, tail, __ATOMIC_RELEASE);
+  // also count entries left over by an interrupted call
+  unsigned int to_submit =
+    tail - __atomic_load_n(self->sq_head, __ATOMIC_ACQUIRE);
+  return io_uring_enter(
+    self->fd, to_submit, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+}
+
+
+void URing_destroy (struct URing *self) {
+  munmap(self->sqes, self->sqes_size);
+  if (self->cq_ring != self->sq_ring) {
+    munmap(self->cq_ring, self->cq_ring_size);
+  }
+  munmap(self->sq_ring, self->sq_ring_size);
+  close(self->fd);
+}
+
+
+int URing_init (struct URing *self, unsigned int entries, unsigned int flags) {
+  struct io_uring_params params = {.flags = flags};
+  self->fd = io_uring_setup(entries, &params);
+  if (self->fd < 0 && errno == EINVAL && flags != 0) {
+    // setup flags not supported by this kernel, try again without them
+    params = (struct io_uring_params) {.flags = 0};
+    self->fd = io_uring_setup(entries, &params);
+  }
+  return_if_fail (self->fd >= 0) -1;
+  self->features = params.features;
+
+  self->sq_ring_size =
+    params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+  self->cq_ring_size =
+    params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (single_mmap) {
+    self->sq_ring_size = self->cq_ring_size =
+      max(self->sq_ring_size, self->cq_ring_size);
+  }
+
+  int saved_errno;
+  self->sq_ring = mmap(
+    NULL, self->sq_ring_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQ_RING);
+  goto_if_fail (self->sq_ring != MAP_FAILED) fail;
+  if (single_mmap) {
+    self->cq_ring = self->sq_ring;
+  } else {
+    self->cq_ring = mmap(
+      NULL, self->cq_ring_size, PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_CQ_RING);
+    goto_if_fail (self->cq_ring != MAP_FAILED) fail_sq_ring;
+  }
+  self->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  self->sqes = mmap(
+    NULL, self->sqes_size, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_POPULATE, self->fd, IORING_OFF_SQES);
+  goto_if_fail (self->sqes != MAP_FAILED) fail_cq_ring;
+
+  char *sq = self->sq_ring;
+  self->sq_head = (unsigned int *) (sq + params.sq_off.head);
+  self->sq_tail = (unsigned int *) (sq + params.sq_off.tail);
+  self->sq_mask = *(unsigned int *) (sq + params.sq_off.ring_mask);
+  self->sq_entries = *(unsigned int *) (sq + params.sq_off.ring_entries);
+  self->sq_array = (unsigned int *) (sq + params.sq_off.array);
+  self->sq_local_tail = *self->sq_tail;
+
+  char *cq = self->cq_ring;
+  self->cq_head = (unsigned int *) (cq + params.cq_off.head);
+  self->cq_tail = (unsigned int *) (cq + params.cq_off.tail);
+  self->cq_mask = *(unsigned int *) (cq + params.cq_off.ring_mask);
+  self->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+  return 0;
+
+fail_cq_ring:
+  saved_errno = errno;
+  if (!single_mmap) {
+    munmap(self->cq_ring, self->cq_ring_size);
+  }
+  errno = saved_errno;
+fail_sq_ring:
+  saved_errno = errno;
+  munmap(self->sq_ring, self->sq_ring_size);
+  errno = saved_errno;
+fail:
+  saved_errno = errno;
+  close(self->fd);
+  errno = saved_errno;
+  return -1;
+}
+
+
+/***/
+
+void URingBufRing_add (struct URingBufRing *self, unsigned short bid) {
+  struct io_uring_buf *buf =
+    &self->br->bufs[self->local_tail & (self->nbuf - 1)];
+  buf->addr = (unsigned long) URingBufRing_buf(self, bid);
+  buf->len = self->buf_size;
+  buf->bid = bid;
+  self->local_tail++;
+}
+
+
+void URingBufRing_destroy (
+    struct URingBufRing *self, const struct URing *ring) {
+  struct io_uring_buf_reg reg = {.bgid = self->bgid};
+  io_uring_register(ring->fd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+  munmap(self->bufs, (size_t) self->buf_size * self->nbuf);
+  munmap(self->br, sizeof(struct io_uring_buf) * self->nbuf);
+}
+
+
+int URingBufRing_init (
+    struct URingBufRing *self, const struct URing *ring, unsigned short bgid,
+    unsigned int nbuf, unsigned int buf_size) {
+  // ring size must be a power of 2
+  should (nbuf > 0 && (nbuf & (nbuf - 1)) == 0 && nbuf <= 32768) otherwise {
+    errno = EINVAL;
+    return -1;
+  }
+  self->nbuf = nbuf;
+  self->buf_size = buf_size;
+  self->bgid = bgid;
+  self->local_tail = 0;
+
+  int saved_errno;
+  self->br = mmap(
+    NULL, sizeof(struct io_uring_buf) * nbuf, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return_if_fail (self->br != MAP_FAILED) -1;
+  self->bufs = mmap(
+    NULL, (size_t) buf_size * nbuf, PROT_READ | PROT_WRITE,
+    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  goto_if_fail (self->bufs != MAP_FAILED) fail_br;
+
+  struct io_uring_buf_reg reg = {
+    .ring_addr = (unsigned long) self->br,
+    .ring_entries = nbuf,
+    .bgid = bgid,
+  };
+  goto_if_fail (io_uring_register(
+    ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0) fail_bufs;
+
+  for (unsigned int i = 0; i < nbuf; i++) {
+    URingBufRing_add(self, i);
+  }
+  URingBufRing_commit(self);
+  return 0;
+
+fail_bufs:
+  saved_errno = errno;
+  munmap(self->bufs, (size_t) buf_size * nbuf);
+  errno = saved_errno;
+fail_br:
+  saved_errno = errno;
+  munmap(self->br, sizeof(struct io_uring_buf) * nbuf);
+  errno = saved_errno;
+  return -1;
+}
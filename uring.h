@@ -0,0 +1,92 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+
+// not in older uapi headers, value is stable since Linux 6.7
+#define URING_OP_READ_MULTISHOT 49
+
+
+struct URing {
+  int fd;
+  unsigned int features;
+
+  unsigned int *sq_head;
+  unsigned int *sq_tail;
+  unsigned int sq_mask;
+  unsigned int sq_entries;
+  unsigned int *sq_array;
+  struct io_uring_sqe *sqes;
+  // tail of SQEs prepared but not yet published to the kernel
+  unsigned int sq_local_tail;
+
+  unsigned int *cq_head;
+  unsigned int *cq_tail;
+  unsigned int cq_mask;
+  struct io_uring_cqe *cqes;
+
+  void *sq_ring;
+  size_t sq_ring_size;
+  void *cq_ring;
+  size_t cq_ring_size;
+  size_t sqes_size;
+};
+
+
+__attribute__((nonnull, warn_unused_result))
+struct io_uring_sqe *URing_get_sqe (struct URing *self);
+__attribute__((nonnull))
+int URing_submit_and_wait (struct URing *self, unsigned int wait_nr);
+__attribute__((nonnull, warn_unused_result, access(read_only, 1)))
+static inline struct io_uring_cqe *URing_peek_cqe (
+    const struct URing *self, unsigned int *head) {
+  unsigned int tail = __atomic_load_n(self->cq_tail, __ATOMIC_ACQUIRE);
+  return *head == tail ? NULL : &self->cqes[(*head)++ & self->cq_mask];
+}
+__attribute__((nonnull))
+static inline void URing_cq_seen (struct URing *self, unsigned int head) {
+  __atomic_store_n(self->cq_head, head, __ATOMIC_RELEASE);
+}
+__attribute__((nonnull))
+void URing_destroy (struct URing *self);
+__attribute__((nonnull, warn_unused_result))
+int URing_init (struct URing *self, unsigned int entries, unsigned int flags);
+
+
+/***/
+
+struct URingBufRing {
+  struct io_uring_buf_ring *br;
+  unsigned char *bufs;
+  unsigned int nbuf;
+  unsigned int buf_size;
+  unsigned short bgid;
+  // tail of buffers returned but not yet published to the kernel
+  unsigned short local_tail;
+};
+
+
+__attribute__((nonnull, pure, warn_unused_result, access(read_only, 1)))
+static inline unsigned char *URingBufRing_buf (
+    const struct URingBufRing *self, unsigned short bid) {
+  return self->bufs + (size_t) self->buf_size * bid;
+}
+__attribute__((nonnull))
+void URingBufRing_add (struct URingBufRing *self, unsigned short bid);
+__attribute__((nonnull))
+static inline void URingBufRing_commit (struct URingBufRing *self) {
+  __atomic_store_n(&self->br->tail, self->local_tail, __ATOMIC_RELEASE);
+}
+__attribute__((nonnull))
+void URingBufRing_destroy (
+  struct URingBufRing *self, const struct URing *ring);
+__attribute__((nonnull, warn_unused_result, access(read_only, 2)))
+int URingBufRing_init (
+  struct URingBufRing *self, const struct URing *ring, unsigned short bgid,
+  unsigned int nbuf, unsigned int buf_size);
+
+
+#endif /* URING_H */